@@ -0,0 +1,64 @@
+#ifndef RAYTRACER_AABB_H
+#define RAYTRACER_AABB_H
+
+#include "rtweekend.h"
+#include "ray_packet.h"
+#include "stats.h"
+
+class aabb {
+public:
+    interval x, y, z;
+
+    aabb() {} // The default AABB is empty, since intervals are empty by default.
+
+    aabb(const interval &ix, const interval &iy, const interval &iz)
+            : x(ix), y(iy), z(iz) {}
+
+    aabb(const point3 &a, const point3 &b) {
+        // Treat the two points a and b as extrema for the bounding box, so we don't require a
+        // particular minimum/maximum coordinate order.
+        x = interval(fmin(a[0], b[0]), fmax(a[0], b[0]));
+        y = interval(fmin(a[1], b[1]), fmax(a[1], b[1]));
+        z = interval(fmin(a[2], b[2]), fmax(a[2], b[2]));
+    }
+
+    aabb(const aabb &box0, const aabb &box1) {
+        x = interval(box0.x, box1.x);
+        y = interval(box0.y, box1.y);
+        z = interval(box0.z, box1.z);
+    }
+
+    aabb pad() const {
+        // Return an AABB that has no side narrower than some delta, padding if necessary.
+        double delta = 0.0001;
+        interval new_x = (x.size() >= delta) ? x : x.expand(delta);
+        interval new_y = (y.size() >= delta) ? y : y.expand(delta);
+        interval new_z = (z.size() >= delta) ? z : z.expand(delta);
+
+        return aabb(new_x, new_y, new_z);
+    }
+
+    bool hit_packet(const ray_packet &rays, double t_min, const double *t_max) const {
+        // Slab test of every lane at once; true if any active lane enters the box
+        // before its current closest hit.
+        RT_COUNT(box_tests);
+        int64_t any = 0;
+#pragma omp simd reduction(|:any)
+        for (int k = 0; k < packet_width; ++k) {
+            auto tx0 = (x.min - rays.origin_x[k]) * rays.inv_direction_x[k];
+            auto tx1 = (x.max - rays.origin_x[k]) * rays.inv_direction_x[k];
+            auto ty0 = (y.min - rays.origin_y[k]) * rays.inv_direction_y[k];
+            auto ty1 = (y.max - rays.origin_y[k]) * rays.inv_direction_y[k];
+            auto tz0 = (z.min - rays.origin_z[k]) * rays.inv_direction_z[k];
+            auto tz1 = (z.max - rays.origin_z[k]) * rays.inv_direction_z[k];
+
+            auto t_enter = fmax(fmax(fmin(tx0, tx1), fmin(ty0, ty1)), fmax(fmin(tz0, tz1), t_min));
+            auto t_exit = fmin(fmin(fmax(tx0, tx1), fmax(ty0, ty1)), fmin(fmax(tz0, tz1), t_max[k]));
+
+            any |= rays.active[k] & (t_enter <= t_exit);
+        }
+        return any != 0;
+    }
+};
+
+#endif //RAYTRACER_AABB_H
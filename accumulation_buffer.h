@@ -0,0 +1,123 @@
+#ifndef RAYTRACER_ACCUMULATION_BUFFER_H
+#define RAYTRACER_ACCUMULATION_BUFFER_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+#include "framebuffer.h"
+#include "image_io.h"
+
+#include <string>
+#include <vector>
+
+// Running sum of linear radiance and the number of samples taken for every pixel.
+// The current estimate of a pixel is its sum divided by its sample count; the sum
+// of squared luminances gives the variance of that estimate.
+class accumulation_buffer {
+public:
+    int width = 0;
+    int height = 0;
+    std::vector<color> sum;
+    std::vector<double> sum_squares;
+    std::vector<int> samples;
+
+    accumulation_buffer() {}
+
+    accumulation_buffer(int _width, int _height)
+            : width(_width), height(_height),
+              sum(static_cast<size_t>(_width) * _height),
+              sum_squares(static_cast<size_t>(_width) * _height, 0.0),
+              samples(static_cast<size_t>(_width) * _height, 0) {}
+
+    void add_sample(int i, int j, const color &c) {
+        auto index = pixel_index(i, j);
+        sum[index] += c;
+        sum_squares[index] += luminance(c) * luminance(c);
+        ++samples[index];
+    }
+
+    color estimate(int i, int j) const {
+        auto index = pixel_index(i, j);
+        if (samples[index] == 0)
+            return color(0, 0, 0);
+        return sum[index] / samples[index];
+    }
+
+    int sample_count(int i, int j) const {
+        return samples[pixel_index(i, j)];
+    }
+
+    double variance_of_mean(int i, int j) const {
+        // Sample variance of the luminance divided by n: the squared standard error
+        // of the pixel estimate. Infinite while there are fewer than two samples.
+        auto index = pixel_index(i, j);
+        auto n = samples[index];
+        if (n < 2)
+            return infinity;
+        auto mean = luminance(sum[index]) / n;
+        auto variance = (sum_squares[index] - n * mean * mean) / (n - 1);
+        return fmax(0.0, variance) / n;
+    }
+
+    double relative_error(int i, int j) const {
+        // Standard error relative to the pixel brightness; the small bias keeps
+        // nearly black pixels from dominating.
+        auto mean = luminance(estimate(i, j));
+        return sqrt(variance_of_mean(i, j)) / (mean + 0.01);
+    }
+
+    double mean_relative_error() const {
+        // Root mean square of the relative error over the pixels that have one.
+        double total = 0;
+        int counted = 0;
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                if (samples[pixel_index(i, j)] < 2)
+                    continue;
+                auto e = relative_error(i, j);
+                total += e * e;
+                ++counted;
+            }
+        }
+        return counted == 0 ? infinity : sqrt(total / counted);
+    }
+
+    accumulation_buffer upsampled(int stride) const {
+        // Copy in which every pixel without samples shows the pixel at the top-left
+        // corner of its stride x stride block, for displaying a coarse pass.
+        auto result = *this;
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                auto index = pixel_index(i, j);
+                if (samples[index] != 0)
+                    continue;
+                auto anchor = pixel_index(i - i % stride, j - j % stride);
+                result.sum[index] = sum[anchor];
+                result.sum_squares[index] = sum_squares[anchor];
+                result.samples[index] = samples[anchor];
+            }
+        }
+        return result;
+    }
+
+    framebuffer resolve() const {
+        // Current estimate of every pixel; pixels without samples are black.
+        framebuffer image(width, height);
+        for (int j = 0; j < height; ++j)
+            for (int i = 0; i < width; ++i)
+                image.set(i, j, estimate(i, j));
+        return image;
+    }
+
+    bool write_image(const std::string &path, const tone_settings &tone = {}) const {
+        // Encoded by the extension of path, see encoder_for.
+        return ::write_image(path, resolve(), tone);
+    }
+
+private:
+    size_t pixel_index(int i, int j) const {
+        return static_cast<size_t>(j) * width + i;
+    }
+};
+
+#endif //RAYTRACER_ACCUMULATION_BUFFER_H
@@ -0,0 +1,136 @@
+#ifndef RAYTRACER_ANIMATION_H
+#define RAYTRACER_ANIMATION_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Camera parameters at one point in time of a fly-through.
+struct camera_keyframe {
+    double time;
+    point3 lookfrom;
+    point3 lookat;
+    double vfov;
+    double focus_dist;
+};
+
+// Keyframed camera path. Positions follow a Catmull-Rom spline through the keyframes,
+// so the camera moves smoothly through them; vfov and focus_dist are interpolated
+// linearly. Times before the first or after the last keyframe hold that keyframe.
+class camera_path {
+public:
+    std::vector<camera_keyframe> keys;
+
+    void add(const camera_keyframe &key) {
+        keys.push_back(key);
+        std::stable_sort(keys.begin(), keys.end(),
+                         [](const camera_keyframe &a, const camera_keyframe &b) { return a.time < b.time; });
+    }
+
+    bool load(const std::string &path) {
+        // One keyframe per line: time, lookfrom x y z, lookat x y z, vfov, focus_dist.
+        // Blank lines and lines starting with # are skipped.
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "Cannot open camera path " << path << '\n';
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream fields(line);
+            camera_keyframe key;
+            double fx, fy, fz, ax, ay, az;
+            if (!(fields >> key.time >> fx >> fy >> fz >> ax >> ay >> az >> key.vfov >> key.focus_dist)) {
+                std::cerr << "Bad keyframe in " << path << ": " << line << '\n';
+                return false;
+            }
+            key.lookfrom = point3(fx, fy, fz);
+            key.lookat = point3(ax, ay, az);
+            add(key);
+        }
+        return !keys.empty();
+    }
+
+    double start_time() const { return keys.front().time; }
+
+    double end_time() const { return keys.back().time; }
+
+    camera_keyframe at(double time) const {
+        if (time <= keys.front().time)
+            return keys.front();
+        if (time >= keys.back().time)
+            return keys.back();
+
+        size_t k = 1;
+        while (keys[k].time < time)
+            ++k;
+
+        auto &p1 = keys[k - 1];
+        auto &p2 = keys[k];
+        auto &p0 = keys[k >= 2 ? k - 2 : k - 1];
+        auto &p3 = keys[k + 1 < keys.size() ? k + 1 : k];
+        auto t = (time - p1.time) / (p2.time - p1.time);
+
+        camera_keyframe result;
+        result.time = time;
+        result.lookfrom = catmull_rom(p0.lookfrom, p1.lookfrom, p2.lookfrom, p3.lookfrom, t);
+        result.lookat = catmull_rom(p0.lookat, p1.lookat, p2.lookat, p3.lookat, t);
+        result.vfov = p1.vfov + t * (p2.vfov - p1.vfov);
+        result.focus_dist = p1.focus_dist + t * (p2.focus_dist - p1.focus_dist);
+        return result;
+    }
+
+private:
+    static point3 catmull_rom(const point3 &p0, const point3 &p1, const point3 &p2, const point3 &p3, double t) {
+        auto t2 = t * t;
+        auto t3 = t2 * t;
+        return 0.5 * ((2 * p1) + (-1 * p0 + p2) * t + (2 * p0 - 5 * p1 + 4 * p2 - p3) * t2
+                      + (-1 * p0 + 3 * p1 - 3 * p2 + p3) * t3);
+    }
+};
+
+inline bool frame_file_name(const std::string &pattern, int frame, std::string &name) {
+    // Name of one frame of a sequence, e.g. "frame_%04d.ppm" -> "frame_0012.ppm". The
+    // pattern must hold exactly one %d or %0Nd, which becomes the frame number padded
+    // with zeros to N digits; %% stands for a percent sign. The number is put in here
+    // rather than by printf, so a user's pattern is never used as a format string.
+    name.clear();
+    int conversions = 0;
+    for (size_t k = 0; k < pattern.size(); ++k) {
+        if (pattern[k] != '%') {
+            name += pattern[k];
+            continue;
+        }
+        if (k + 1 < pattern.size() && pattern[k + 1] == '%') {
+            name += '%';
+            ++k;
+            continue;
+        }
+
+        size_t width = 0;
+        auto end = k + 1;
+        if (end < pattern.size() && pattern[end] == '0')
+            for (++end; end < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[end])); ++end)
+                width = std::min<size_t>(10 * width + (pattern[end] - '0'), 64);
+        if (end >= pattern.size() || pattern[end] != 'd' || ++conversions > 1)
+            return false;
+
+        auto digits = std::to_string(frame);
+        if (digits.size() < width)
+            name.append(width - digits.size(), '0');
+        name += digits;
+        k = end;
+    }
+    return conversions == 1;
+}
+
+#endif //RAYTRACER_ANIMATION_H
@@ -0,0 +1,139 @@
+#ifndef RAYTRACER_AOV_H
+#define RAYTRACER_AOV_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+#include "framebuffer.h"
+#include "hittable.h"
+#include "image_io.h"
+#include "material.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Auxiliary output buffers (AOVs) gathered from the first hit of every camera sample:
+// albedo, shading normal, distance along the camera ray and which primitive and
+// material were hit. Albedo and normal are averaged over all samples of a pixel, the
+// distance over the samples that hit something, and the ids come from the first
+// sample that hit something. A sample that hits nothing counts the background as its albedo.
+class aov_buffer {
+public:
+    int width = 0;
+    int height = 0;
+    std::vector<color> albedo_sum;
+    std::vector<vec3> normal_sum;
+    std::vector<double> distance_sum;
+    std::vector<int> samples;
+    std::vector<int> hits;
+    std::vector<const hittable *> object;
+    std::vector<const material *> mat;
+
+    aov_buffer() {}
+
+    aov_buffer(int _width, int _height)
+            : width(_width), height(_height),
+              albedo_sum(static_cast<size_t>(_width) * _height),
+              normal_sum(albedo_sum.size()),
+              distance_sum(albedo_sum.size(), 0.0),
+              samples(albedo_sum.size(), 0),
+              hits(albedo_sum.size(), 0),
+              object(albedo_sum.size(), nullptr),
+              mat(albedo_sum.size(), nullptr) {}
+
+    void add_hit(int i, int j, const ray &r, const hit_record &rec) {
+        auto index = pixel_index(i, j);
+        if (!object[index]) {
+            object[index] = rec.object;
+            mat[index] = rec.mat.get();
+        }
+        albedo_sum[index] += rec.mat->albedo_at(rec);
+        normal_sum[index] += rec.normal;
+        distance_sum[index] += rec.t * r.direction().length();
+        ++samples[index];
+        ++hits[index];
+    }
+
+    void add_miss(int i, int j, const color &background) {
+        auto index = pixel_index(i, j);
+        albedo_sum[index] += background;
+        ++samples[index];
+    }
+
+    framebuffer albedo() const {
+        framebuffer image(width, height);
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                auto index = pixel_index(i, j);
+                if (samples[index] > 0)
+                    image.set(i, j, albedo_sum[index] / samples[index]);
+            }
+        }
+        return image;
+    }
+
+    framebuffer normal() const {
+        // Unit length where anything was hit, zero elsewhere.
+        framebuffer image(width, height);
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                auto n = normal_sum[pixel_index(i, j)];
+                if (n.length_squared() > 0)
+                    image.set(i, j, unit_vector(n));
+            }
+        }
+        return image;
+    }
+
+    framebuffer distance() const {
+        // Same value in all three channels; zero where nothing was hit.
+        framebuffer image(width, height);
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                auto index = pixel_index(i, j);
+                if (hits[index] > 0) {
+                    auto d = distance_sum[index] / hits[index];
+                    image.set(i, j, color(d, d, d));
+                }
+            }
+        }
+        return image;
+    }
+
+    framebuffer ids() const {
+        // Primitive id in red, material id in green. Ids are numbered from 1 in the
+        // order they first appear in scanline order; 0 means nothing was hit.
+        std::unordered_map<const hittable *, int> object_ids;
+        std::unordered_map<const material *, int> material_ids;
+        framebuffer image(width, height);
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                auto index = pixel_index(i, j);
+                if (!object[index])
+                    continue;
+                auto object_id = object_ids.emplace(object[index], object_ids.size() + 1).first->second;
+                auto material_id = material_ids.emplace(mat[index], material_ids.size() + 1).first->second;
+                image.set(i, j, color(object_id, material_id, 0));
+            }
+        }
+        return image;
+    }
+
+    bool write(const std::string &image_path) const {
+        // Next to the image: image_albedo.pfm, image_normal.pfm, image_depth.pfm and
+        // image_id.pfm, all as linear floats.
+        auto stem = path_stem(image_path);
+        return write_image(stem + "_albedo.pfm", albedo())
+               && write_image(stem + "_normal.pfm", normal())
+               && write_image(stem + "_depth.pfm", distance())
+               && write_image(stem + "_id.pfm", ids());
+    }
+
+private:
+    size_t pixel_index(int i, int j) const {
+        return static_cast<size_t>(j) * width + i;
+    }
+};
+
+#endif //RAYTRACER_AOV_H
@@ -3,12 +3,46 @@
 
 #include "rtweekend.h"
 
+#include "accumulation_buffer.h"
+#include "animation.h"
+#include "aov.h"
+#include "checkpoint.h"
 #include "color.h"
+#include "denoise.h"
+#include "filter.h"
+#include "heatmap.h"
 #include "hittable.h"
+#include "hittable_list.h"
+#include "image_io.h"
+#include "image_writer.h"
 #include "material.h"
+#include "sampler.h"
+#include "shared_framebuffer.h"
+#include "stats.h"
+#include "streamed_image.h"
+#include "tile_pool.h"
+#include "wavefront.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Set by SIGINT during a progressive render: the current pass finishes, the image
+// is written and the render returns.
+inline volatile std::sig_atomic_t render_interrupted = 0;
+
+// Rectangle of pixels [x0, x1) x [y0, y1), used to render part of the frame.
+struct pixel_region {
+    int x0, y0, x1, y1;
+};
 
 class camera {
 public:
@@ -19,6 +53,8 @@ public:
     int max_depth = 10;   // Maximum number of ray bounces into scene
     color background;               // Scene background color
     point3 light = point3(0, 100, 0); // Lighting source
+    color light_color = color(1, 1, 1); // Strength of the point light in previews (black disables it)
+    hittable_list lights;           // Emissive objects that previews shade as area lights
 
     double vfov = 90;  // Vertical view angle (field of view)
     point3 lookfrom = point3(0, 0, -1);  // Point camera is looking from
@@ -28,28 +64,674 @@ public:
     double defocus_angle = 0;  // Variation angle of rays through each pixel
     double focus_dist = 10;    // Distance from camera lookfrom point to plane of perfect focus
 
+    shared_ptr<sampler> pixel_sampler = make_shared<independent_sampler>(); // Sample sequence per pixel
+
+    int samples_per_pass = 4;       // Samples added to every pixel per progressive pass
+    double preview_interval = 2.0;  // Seconds between writes of the progressive estimate
+    bool coarse_to_fine = false;    // Start progressive renders with 1/16 and 1/4 resolution passes
+
+    std::string checkpoint_file;     // Where progressive renders save their state ("" = never)
+    double checkpoint_interval = 60; // Seconds between checkpoints
+    std::string resume_file;         // Checkpoint to continue a progressive render from
+
+    double time_budget = 10;         // Wall-clock seconds render_budgeted may take
+    bool adaptive_sampling = false;  // Spend budgeted passes on the noisiest pixels
+
+    std::vector<pixel_region> regions; // Parts of the frame render_regions traces
+    std::string composite_file;        // Image the regions are pasted into ("" = the output file)
+
+    int wavefront_batch = 1 << 16;   // Paths in flight per batch in render_wavefront
+    bool reorder_rays = false;       // Sort secondary rays for coherence in render_wavefront
+
+    int thread_count = 0;            // Worker threads of the tiled and pass renders (0 = one per core)
+    int tile_size = 32;              // Edge in pixels of the tiles the workers take
+    pixel_filter filter;             // Reconstruction filter of render() and render_views()
+
+    std::string output_file = "../image2.ppm"; // Where the image goes: .ppm (binary), .png or .pfm (float)
+    tone_settings tone;                        // Exposure and curves of 8-bit output
+    std::string shared_memory_name;            // POSIX shm object the film is published to, e.g. "/raytracer"
+    bool write_aovs = false;                   // Also write albedo, normal, depth and id buffers (see aov.h)
+    bool apply_denoiser = false;               // Denoise the image, guided by the AOVs, before writing it
+    denoise_settings denoiser;
+    bool write_heatmap = false;                // Also write the time spent on every pixel as a heatmap (see heatmap.h)
+
     void render(const hittable &world) {
+        render_views(world, {this}, {output_file});
+    }
+
+    static void render_views(const hittable &world, const std::vector<camera *> &views,
+                             const std::vector<std::string> &files) {
+        // Renders several views of one scene, e.g. a stereo pair or turntable, as a single
+        // job: the tiles of all views go through one pool of worker threads that share
+        // the scene, so workers done with a cheap view help with an expensive one.
+        // views[k] is written to files[k]; the first view's thread_count is used.
+        // Views with a filter other than box splat their samples into a splat_film:
+        // each tile fills a private window that overlaps its neighbours by the filter
+        // radius and adds it to the view's film under film_mutex, once per tile. The
+        // order of those merges varies between runs, so the last bits of such images
+        // may too. Views with write_heatmap time every pixel and write the times next
+        // to the image as image_cost; stats builds also count the intersection tests
+        // of every pixel into image_tests.
+        std::vector<render_tile> tiles;
+        std::vector<accumulation_buffer> films;
+        std::vector<splat_film> splats(views.size());
+        std::mutex film_mutex;
+        std::vector<aov_buffer> aovs(views.size());
+        std::vector<cost_buffer> times(views.size()), tests(views.size());
+        std::vector<std::atomic<size_t>> tiles_left(views.size());
+        std::vector<std::unique_ptr<shared_framebuffer>> shared(views.size());
+        for (size_t k = 0; k < views.size(); ++k) {
+            auto &view = *views[k];
+            view.initialize();
+            films.emplace_back(view.image_width, view.image_height);
+            if (view.filter.kind != filter_kind::box)
+                splats[k] = splat_film(0, 0, view.image_width, view.image_height);
+            if (view.write_aovs || view.apply_denoiser)
+                aovs[k] = aov_buffer(view.image_width, view.image_height);
+            if (view.write_heatmap) {
+                times[k] = cost_buffer(view.image_width, view.image_height);
+#if RAYTRACER_STATS
+                tests[k] = cost_buffer(view.image_width, view.image_height);
+#endif
+            }
+            if (!view.shared_memory_name.empty())
+                shared[k] = std::make_unique<shared_framebuffer>(view.shared_memory_name, view.image_width,
+                                                                 view.image_height);
+            auto first = tiles.size();
+            append_tiles(tiles, static_cast<int>(k), view.image_width, view.image_height, view.tile_size);
+            tiles_left[k] = tiles.size() - first;
+        }
+
+        // Every worker draws from its own copy of each view's sampler.
+        auto workers = worker_count(views.front()->thread_count);
+        std::vector<std::vector<shared_ptr<sampler>>> samplers(workers);
+        std::atomic<size_t> tiles_done{0};
+
+        // A view is written by the writer thread as soon as its last tile is done,
+        // while the workers go on with the other views.
+        image_writer writer;
+
+        run_tiles(tiles, workers, [&](int worker) {
+            for (auto view: views)
+                samplers[worker].push_back(view->pixel_sampler->clone());
+        }, [&](const render_tile &tile, int worker) {
+            auto &view = *views[tile.view];
+            auto view_aovs = view.write_aovs || view.apply_denoiser ? &aovs[tile.view] : nullptr;
+            auto measure = [&](int i, int j, auto &&trace) {
+                if (!view.write_heatmap) {
+                    trace();
+                    return;
+                }
+#if RAYTRACER_STATS
+                auto tests_before = thread_stats().sphere_tests + thread_stats().quad_tests;
+#endif
+                auto start = std::chrono::steady_clock::now();
+                trace();
+                std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+                times[tile.view].add(i, j, elapsed.count());
+#if RAYTRACER_STATS
+                tests[tile.view].add(i, j, static_cast<double>(thread_stats().sphere_tests
+                                                               + thread_stats().quad_tests - tests_before));
+#endif
+            };
+
+            active_sampler() = samplers[worker][tile.view].get();
+            if (view.filter.kind == filter_kind::box) {
+                for (int j = tile.y0; j < tile.y1; ++j)
+                    for (int i = tile.x0; i < tile.x1; ++i)
+                        measure(i, j, [&] {
+                            view.render_pixel(world, films[tile.view], i, j, view.samples_per_pixel, view_aovs);
+                        });
+
+                if (shared[tile.view] && shared[tile.view]->good())
+                    shared[tile.view]->publish_tile(films[tile.view], tile.x0, tile.y0, tile.x1, tile.y1);
+            } else {
+                auto border = static_cast<int>(ceil(view.filter.radius));
+                splat_film window(tile.x0 - border, tile.y0 - border,
+                                  tile.x1 - tile.x0 + 2 * border, tile.y1 - tile.y0 + 2 * border);
+                for (int j = tile.y0; j < tile.y1; ++j)
+                    for (int i = tile.x0; i < tile.x1; ++i)
+                        measure(i, j, [&] { view.render_pixel_filtered(world, window, i, j, view_aovs); });
+
+                std::lock_guard<std::mutex> lock(film_mutex);
+                splats[tile.view].merge(window);
+                if (shared[tile.view] && shared[tile.view]->good())
+                    shared[tile.view]->publish_tile(splats[tile.view], tile.x0, tile.y0, tile.x1, tile.y1);
+            }
+            active_sampler() = nullptr;
+
+            if (--tiles_left[tile.view] == 0) {
+                auto k = tile.view;
+                if (shared[k] && shared[k]->good())
+                    shared[k]->set_sample_count(view.samples_per_pixel);
+                writer.submit([&films, &splats, &aovs, &times, &tests, &files, &views, k] {
+                    auto image = views[k]->filter.kind == filter_kind::box ? films[k].resolve() : splats[k].resolve();
+                    if (views[k]->apply_denoiser)
+                        image = denoise(image, aovs[k].albedo(), aovs[k].normal(), aovs[k].distance(),
+                                        views[k]->denoiser);
+                    write_image(files[k], image, views[k]->tone);
+                    if (views[k]->write_aovs)
+                        aovs[k].write(files[k]);
+                    if (views[k]->write_heatmap) {
+                        auto stem = path_stem(files[k]);
+                        auto extension = files[k].substr(stem.size());
+                        times[k].write(stem + "_cost" + extension, "microseconds");
+#if RAYTRACER_STATS
+                        tests[k].write(stem + "_tests" + extension, "intersection tests");
+#endif
+                    }
+                });
+            }
+
+            auto done = ++tiles_done;
+            if (worker == 0)
+                std::clog << "\rTiles remaining: " << (tiles.size() - done) << "    " << std::flush;
+        });
+
+        writer.finish();
+        std::clog << "\rDone.                       \n";
+    }
+
+    void render_streamed(const hittable &world) {
+        // Same image as render(), for frames too large to keep in memory: each finished
+        // tile is tone mapped and written straight to its place in the output file, so
+        // only the tiles being traced are resident (see streamed_image).
         initialize();
 
-        std::ofstream myFile;
-        myFile.open("../image2.ppm");
+        streamed_image output(output_file, image_width, image_height, tone);
+        if (!output.good())
+            return;
+
+        tile_grid grid{0, image_width, image_height, tile_size};
+        auto workers = worker_count(thread_count);
+        std::vector<shared_ptr<sampler>> samplers(workers);
+        std::atomic<size_t> tiles_done{0};
+
+        // Tone mapping and writing happen on the writer thread; its bounded queue keeps
+        // the number of finished tiles in memory small.
+        image_writer writer(2 * workers);
+
+        run_jobs(grid.count(), workers, [&](int worker) {
+            samplers[worker] = pixel_sampler->clone();
+        }, [&](size_t k, int worker) {
+            auto tile = grid.at(k);
+            framebuffer pixels(tile.x1 - tile.x0, tile.y1 - tile.y0);
+
+            active_sampler() = samplers[worker].get();
+            for (int j = tile.y0; j < tile.y1; ++j) {
+                for (int i = tile.x0; i < tile.x1; ++i) {
+                    RT_TIME_PHASE(trace);
+                    color pixel_color(0, 0, 0);
+                    for (int sample = 0; sample < samples_per_pixel; ++sample) {
+                        active_sampler()->start_pixel_sample(i, j, sample);
+                        pixel_color += ray_color(get_ray(i, j), max_depth, world);
+                    }
+                    pixels.set(i - tile.x0, j - tile.y0, pixel_color / samples_per_pixel);
+                }
+            }
+            active_sampler() = nullptr;
+
+            writer.submit([&output, tile, pixels = std::move(pixels)] {
+                output.write_tile(tile.x0, tile.y0, pixels);
+            });
+
+            auto done = ++tiles_done;
+            if (worker == 0)
+                std::clog << "\rTiles remaining: " << (grid.count() - done) << "    " << std::flush;
+        });
+
+        writer.finish();
+        if (output.finish())
+            std::clog << "\rDone.                       \n";
+    }
+
+    bool render_progressive(const hittable &world) {
+        // Renders whole-frame passes of samples_per_pass samples into an HDR buffer and
+        // writes the current estimate every preview_interval seconds, so the image is
+        // usable long before all samples_per_pixel are in. Ctrl-C stops after the pass.
+        // With resume_file set the render continues from a checkpoint; raising
+        // samples_per_pixel adds samples to a render that had already finished.
+        // Returns false if the checkpoint cannot be resumed.
+        initialize();
 
-        myFile << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+        accumulation_buffer film(image_width, image_height);
+
+        if (!resume_file.empty()) {
+            if (!load_checkpoint(resume_file, film, *pixel_sampler))
+                return false;
+            std::clog << "Resuming from " << resume_file << '\n';
+        }
+
+        render_interrupted = 0;
+        auto previous_handler = std::signal(SIGINT, [](int) { render_interrupted = 1; });
+
+        auto start = std::chrono::steady_clock::now();
+        auto last_write = start;
+        auto last_checkpoint = start;
+
+        // Previews are encoded and written on their own thread while the next pass runs.
+        image_writer writer;
+        std::unique_ptr<shared_framebuffer> shared;
+        if (!shared_memory_name.empty())
+            shared = std::make_unique<shared_framebuffer>(shared_memory_name, image_width, image_height);
+
+        if (coarse_to_fine)
+            render_coarse_passes(world, film, start, writer);
+
+        int samples_done = *std::min_element(film.samples.begin(), film.samples.end());
+        while (samples_done < samples_per_pixel && !render_interrupted) {
+            int pass_samples = std::min(samples_per_pass, samples_per_pixel - samples_done);
+            render_pass(world, film, samples_done + pass_samples);
+            samples_done += pass_samples;
+            if (shared && shared->good())
+                shared->publish(film, samples_done);
+
+            auto now = std::chrono::steady_clock::now();
+            std::chrono::duration<double> elapsed = now - start;
+            std::clog << "\rSamples per pixel: " << samples_done << '/' << samples_per_pixel
+                      << " (" << elapsed.count() << "s) " << std::flush;
+
+            if (std::chrono::duration<double>(now - last_write).count() >= preview_interval) {
+                submit_image(writer, film);
+                last_write = now;
+            }
+
+            if (!checkpoint_file.empty()
+                && std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_interval) {
+                save_checkpoint(checkpoint_file, film, *pixel_sampler);
+                last_checkpoint = now;
+            }
+        }
+
+        submit_image(writer, film);
+        if (!checkpoint_file.empty())
+            save_checkpoint(checkpoint_file, film, *pixel_sampler);
+        writer.finish();
+        std::signal(SIGINT, previous_handler);
+
+        std::clog << "\rDone with " << samples_done << " samples per pixel.       \n";
+        return true;
+    }
+
+    void render_budgeted(const hittable &world) {
+        // Keeps adding passes of samples_per_pass samples until time_budget seconds
+        // have passed, then writes the best image it has; samples_per_pixel is ignored.
+        // With adaptive_sampling every pass after the first goes to the quarter of the
+        // pixels with the largest relative error instead of to the whole frame.
+        initialize();
+
+        accumulation_buffer film(image_width, image_height);
+
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(time_budget));
+
+        // Two samples per pixel are the least that give a variance estimate.
+        int uniform_target = 0;
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (!adaptive_sampling || uniform_target == 0) {
+                uniform_target += std::max(samples_per_pass, uniform_target == 0 ? 2 : 1);
+                render_pass(world, film, uniform_target, deadline);
+            } else {
+                render_noisiest(world, film, 0.25, deadline);
+            }
+        }
+
+        film.write_image(output_file, tone);
+
+        long long total_samples = 0;
+        int fewest = film.samples.empty() ? 0 : film.samples[0];
+        int most = fewest;
+        for (auto count: film.samples) {
+            total_samples += count;
+            fewest = std::min(fewest, count);
+            most = std::max(most, count);
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::clog << "\rRendered for " << elapsed.count() << "s: "
+                  << static_cast<double>(total_samples) / film.samples.size() << " samples per pixel (min "
+                  << fewest << ", max " << most << "), relative error " << film.mean_relative_error()
+                  << "        \n";
+    }
+
+    void render_wavefront(const hittable &world) {
+        // Same image as render(), traced breadth-first by the wavefront integrator
+        // in batches of wavefront_batch camera paths.
+        initialize();
+
+        accumulation_buffer film(image_width, image_height);
+        wavefront_integrator integrator(world, background, max_depth);
+        integrator.reorder_secondary = reorder_rays;
+
+        std::vector<wavefront_path> batch;
+        batch.reserve(wavefront_batch);
 
         for (int j = 0; j < image_height; ++j) {
             std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
+            RT_TIME_PHASE(trace);
             for (int i = 0; i < image_width; ++i) {
-                color pixel_color(0, 0, 0);
                 for (int sample = 0; sample < samples_per_pixel; ++sample) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
+                    wavefront_path path;
+                    path.pixel_i = i;
+                    path.pixel_j = j;
+                    path.sample_index = sample;
+
+                    pixel_sampler->start_pixel_sample(i, j, sample);
+                    active_sampler() = pixel_sampler.get();
+                    path.r = get_ray(i, j);
+                    path.dimension = pixel_sampler->current_dimension();
+                    active_sampler() = nullptr;
+
+                    batch.push_back(path);
+                    if (static_cast<int>(batch.size()) == wavefront_batch) {
+                        integrator.trace(batch, *pixel_sampler, film);
+                        batch.clear();
+                    }
+                }
+            }
+        }
+        {
+            RT_TIME_PHASE(trace);
+            integrator.trace(batch, *pixel_sampler, film);
+        }
+
+        film.write_image(output_file, tone);
+        std::clog << "\rDone.                       \n";
+
+        auto report = [](const char *label, const ray_order_stats &stats) {
+            std::clog << label << stats.rays << " rays, " << stats.switch_rate()
+                      << " primitive switches per ray, " << stats.rays_per_second() << " rays/s\n";
+        };
+        report("Camera rays:    ", integrator.primary_stats);
+        report("Secondary rays: ", integrator.secondary_stats);
+    }
+
+    void render_packets(const hittable &world) {
+        // Same image as render(), but the camera rays of packet_width neighbouring pixels
+        // are traced together as one packet. They are nearly parallel, so they visit the
+        // same boxes and primitives; only the first hit is found this way and every lane
+        // continues as a single ray from there.
+        initialize();
+
+        accumulation_buffer film(image_width, image_height);
+        ray_packet rays;
+        packet_hit hits;
+        int lane_dimension[packet_width];
+
+        for (int j = 0; j < image_height; ++j) {
+            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
+            RT_TIME_PHASE(trace);
+            for (int first_i = 0; first_i < image_width; first_i += packet_width) {
+                for (int sample = 0; sample < samples_per_pixel; ++sample) {
+                    active_sampler() = pixel_sampler.get();
+                    for (int k = 0; k < packet_width; ++k) {
+                        auto i = first_i + k;
+                        if (i >= image_width) {
+                            rays.deactivate(k);
+                            continue;
+                        }
+                        pixel_sampler->start_pixel_sample(i, j, sample);
+                        rays.set(k, get_ray(i, j));
+                        lane_dimension[k] = pixel_sampler->current_dimension();
+                    }
+
+                    hits.reset();
+                    world.hit_packet(rays, 0.001, hits);
+
+                    for (int k = 0; k < packet_width; ++k) {
+                        if (!rays.active[k])
+                            continue;
+                        auto i = first_i + k;
+                        pixel_sampler->resume_pixel_sample(i, j, sample, lane_dimension[k]);
+                        film.add_sample(i, j, packet_lane_color(rays.lane(k), hits.object[k], world));
+                    }
+                    active_sampler() = nullptr;
+                }
+            }
+        }
+
+        film.write_image(output_file, tone);
+        std::clog << "\rDone.                       \n";
+    }
+
+    void render_preview(const hittable &world) {
+        // One sample per pixel of direct lighting with hard shadows (see preview_color),
+        // for framing a shot before starting the path tracer.
+        initialize();
+
+        auto start = std::chrono::steady_clock::now();
+
+        // Neighbouring pixels share the point light, so the shadow rays of packet_width
+        // of them are traced together as one packet (see packet_occluded).
+        accumulation_buffer film(image_width, image_height);
+        ray camera_rays[packet_width];
+        hit_record hits[packet_width];
+        color colors[packet_width];
+        bool lit[packet_width], occluded[packet_width];
+        ray_packet shadow_rays;
+        auto has_light = light_color.length_squared() > 0;
+
+        active_sampler() = pixel_sampler.get();
+        for (int j = 0; j < image_height; ++j) {
+            RT_TIME_PHASE(trace);
+            for (int first_i = 0; first_i < image_width; first_i += packet_width) {
+                for (int k = 0; k < packet_width; ++k) {
+                    auto i = first_i + k;
+                    lit[k] = false;
+                    shadow_rays.deactivate(k);
+                    if (i >= image_width)
+                        continue;
+
+                    // Misses and specular hits are finished right away, as preview_color would.
+                    pixel_sampler->start_pixel_sample(i, j, 0);
+                    camera_rays[k] = get_ray(i, j);
+                    if (max_depth <= 0) {
+                        colors[k] = color(0, 0, 0);
+                        continue;
+                    }
+                    RT_COUNT_RAYS(0, 1);
+                    if (!world.hit(camera_rays[k], interval(0.001, infinity), hits[k])) {
+                        colors[k] = background;
+                        continue;
+                    }
+                    if (hits[k].mat->is_specular()) {
+                        colors[k] = preview_specular(camera_rays[k], hits[k], max_depth, world);
+                        continue;
+                    }
+
+                    lit[k] = true;
+                    if (has_light) {
+                        RT_COUNT(shadow_rays);
+                        shadow_rays.set(k, ray(hits[k].p, light - hits[k].p));
+                    }
+                }
+
+                packet_occluded(world, shadow_rays, occluded);
+
+                for (int k = 0; k < packet_width && first_i + k < image_width; ++k) {
+                    if (lit[k])
+                        colors[k] = preview_direct(camera_rays[k], hits[k], has_light && !occluded[k], world);
+                    film.add_sample(first_i + k, j, colors[k]);
                 }
-                write_color(myFile, pixel_color, samples_per_pixel);
             }
         }
+        active_sampler() = nullptr;
 
-        std::clog << "\rDone.                       ";
-        myFile.close();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        film.write_image(output_file, tone);
+        std::clog << "Preview rendered in " << elapsed.count() << " ms\n";
+    }
+
+    void add_strip(int index, int count) {
+        // Region of the index-th of count horizontal strips; strips of one frame can be
+        // rendered by independent jobs and composited into the same file.
+        auto height = full_image_height();
+        regions.push_back({0, height * index / count, image_width, height * (index + 1) / count});
+    }
+
+    bool render_regions(const hittable &world) {
+        // Traces only the pixels inside the regions and pastes them into composite_file
+        // (or the output file if that is not set), written to the output file. Pixels
+        // outside the regions keep the values of that image, or stay black if it does
+        // not exist or has a different size. Both files must be PPMs, since the pixels
+        // are pasted as 8-bit values and the next strip is pasted into the result.
+        auto base_file = composite_file.empty() ? output_file : composite_file;
+        if (!has_extension(output_file, ".ppm") || !has_extension(base_file, ".ppm")) {
+            std::cerr << "Region renders are composited as PPM: " << base_file << " and " << output_file
+                      << " must both end in .ppm\n";
+            return false;
+        }
+
+        initialize();
+
+        rgb_image image;
+        if (!read_ppm(base_file, image) || image.width != image_width || image.height != image_height) {
+            std::clog << "Compositing onto a black " << image_width << 'x' << image_height << " image\n";
+            image = rgb_image(image_width, image_height);
+        }
+
+        // Regions may overlap, so their pixels are marked first; each row with marked
+        // pixels is then a job of its own and every pixel is traced by one worker only.
+        std::vector<char> inside(static_cast<size_t>(image_width) * image_height, 0);
+        std::vector<char> row_inside(image_height, 0);
+        for (const auto &region: regions) {
+            auto x0 = std::max(region.x0, 0), x1 = std::min(region.x1, image_width);
+            auto y0 = std::max(region.y0, 0), y1 = std::min(region.y1, image_height);
+            for (int j = y0; j < y1; ++j) {
+                for (int i = x0; i < x1; ++i) {
+                    inside[static_cast<size_t>(j) * image_width + i] = 1;
+                    row_inside[j] = 1;
+                }
+            }
+        }
+        std::vector<int> rows;
+        for (int j = 0; j < image_height; ++j)
+            if (row_inside[j])
+                rows.push_back(j);
+
+        accumulation_buffer film(image_width, image_height);
+        std::atomic<size_t> rows_done{0};
+        run_pixel_jobs(rows.size(), [&](size_t k, int worker) {
+            auto j = rows[k];
+            for (int i = 0; i < image_width; ++i)
+                if (inside[static_cast<size_t>(j) * image_width + i])
+                    render_pixel(world, film, i, j, samples_per_pixel);
+
+            auto done = ++rows_done;
+            if (worker == 0)
+                std::clog << "\rScanlines remaining in regions: " << (rows.size() - done) << ' ' << std::flush;
+        });
+
+        // Tone map the whole film at once, then paste the traced pixels.
+        RT_TIME_PHASE(write);
+        auto traced = to_rgb_image(film.resolve(), tone);
+        for (int j = 0; j < image_height; ++j)
+            for (int i = 0; i < image_width; ++i)
+                if (film.sample_count(i, j) > 0)
+                    std::copy(traced.pixel(i, j), traced.pixel(i, j) + 3, image.pixel(i, j));
+
+        if (!write_ppm(output_file, image))
+            return false;
+        std::clog << "\rDone.                              \n";
+        return true;
+    }
+
+    bool render_sequence(const hittable &world, const camera_path &path, int frame_count,
+                         const std::string &file_pattern) {
+        // Renders frame_count frames evenly spaced over the path in this one process,
+        // so the scene and its bounding boxes are built once. file_pattern names the
+        // frames, e.g. "frame_%04d.ppm" (see frame_file_name); false if it is invalid.
+        // The tiles of each frame are shared by thread_count workers as in render(),
+        // and frame N is encoded and written by the writer thread while frame N + 1
+        // renders.
+        std::string file_name;
+        if (!frame_file_name(file_pattern, 0, file_name)) {
+            std::cerr << "Frame pattern " << file_pattern << " must contain one %d or %0Nd, e.g. frame_%04d.ppm\n";
+            return false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        image_writer writer(1);
+
+        for (int frame = 0; frame < frame_count; ++frame) {
+            auto time = frame_count > 1
+                        ? path.start_time() + (path.end_time() - path.start_time()) * frame / (frame_count - 1)
+                        : path.start_time();
+            auto key = path.at(time);
+            lookfrom = key.lookfrom;
+            lookat = key.lookat;
+            vfov = key.vfov;
+            focus_dist = key.focus_dist;
+            initialize();
+
+            // Every tile covers its own pixels of the film, so workers need no locking.
+            accumulation_buffer film(image_width, image_height);
+            tile_grid grid{0, image_width, image_height, tile_size};
+            run_pixel_jobs(grid.count(), [&](size_t k, int) {
+                auto tile = grid.at(k);
+                for (int j = tile.y0; j < tile.y1; ++j)
+                    for (int i = tile.x0; i < tile.x1; ++i)
+                        render_pixel(world, film, i, j, samples_per_pixel);
+            });
+
+            frame_file_name(file_pattern, frame, file_name);
+            writer.submit([film = std::move(film), name = file_name, settings = tone] {
+                film.write_image(name, settings);
+            });
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            std::clog << "\rFrame " << frame + 1 << '/' << frame_count << ", "
+                      << 3600.0 * (frame + 1) / elapsed.count() << " frames/hour    " << std::flush;
+        }
+
+        writer.finish();
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::clog << "\rRendered " << frame_count << " frames in " << elapsed.count() << "s ("
+                  << 3600.0 * frame_count / elapsed.count() << " frames/hour)\n";
+        return true;
+    }
+
+    int full_image_height() const {
+        // Calculate the image height, and ensure that it's at least 1.
+        auto height = static_cast<int>(image_width / aspect_ratio);
+        return (height < 1) ? 1 : height;
+    }
+
+    // For callers that drive rendering themselves, such as the interactive viewer:
+    // prepare() applies the current parameters, render_row() then adds the given
+    // number of samples to every pixel of one row of the film.
+    void prepare() {
+        initialize();
+    }
+
+    void render_row(const hittable &world, accumulation_buffer &film, int j, int samples) {
+        active_sampler() = pixel_sampler.get();
+        for (int i = 0; i < image_width; ++i)
+            render_pixel(world, film, i, j, film.sample_count(i, j) + samples);
+        active_sampler() = nullptr;
+    }
+
+    bool center_hit(const hittable &world, int i, int j, hit_record &rec) const {
+        // Closest hit of the ray from the camera center through the middle of pixel
+        // (i, j), without pixel jitter or defocus blur. Needs prepare().
+        auto pixel_center = pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v);
+        return world.hit(ray(center, pixel_center - center), interval(0.001, infinity), rec);
+    }
+
+    bool project(const point3 &p, double &x, double &y) const {
+        // Continuous pixel coordinates of a world point (pixel (i, j) has its middle at
+        // x = i, y = j); false if the point is behind the camera. Needs prepare().
+        auto d = p - center;
+        auto depth = -dot(d, w);
+        if (depth <= 0)
+            return false;
+
+        auto on_viewport = center + d * (focus_dist / depth) - pixel00_loc;
+        x = dot(on_viewport, pixel_delta_u) / pixel_delta_u.length_squared();
+        y = dot(on_viewport, pixel_delta_v) / pixel_delta_v.length_squared();
+        return true;
     }
 
 private:
@@ -65,9 +747,7 @@ private:
 
 
     void initialize() {
-        // Calculate the image height, and ensure that it's at least 1.
-        image_height = static_cast<int>(image_width / aspect_ratio);
-        image_height = (image_height < 1) ? 1 : image_height;
+        image_height = full_image_height();
 
         center = lookfrom;
 
@@ -100,28 +780,243 @@ private:
         defocus_disk_v = v * defocus_radius;
     }
 
+    void render_pass(const hittable &world, accumulation_buffer &film, int end_sample,
+                     std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+        // Takes every pixel of the film up to end_sample samples. Samples are always
+        // added in index order, so the sums do not depend on how passes were split.
+        // Rows not started before the deadline are left for a later pass.
+        run_pixel_jobs(image_height, [&](size_t j, int) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return;
+            for (int i = 0; i < image_width; ++i)
+                render_pixel(world, film, i, static_cast<int>(j), end_sample);
+        });
+    }
+
+    void render_coarse_passes(const hittable &world, accumulation_buffer &film,
+                              std::chrono::steady_clock::time_point start, image_writer &writer) {
+        // One sample for every 4th pixel in both directions, then every 2nd, each written
+        // out upsampled. These are the first samples of those pixels, so the full
+        // resolution passes that follow simply continue from them.
+        for (int stride = 4; stride > 1; stride /= 2) {
+            auto rows = (image_height + stride - 1) / stride;
+            run_pixel_jobs(rows, [&](size_t row, int) {
+                auto j = static_cast<int>(row) * stride;
+                for (int i = 0; i < image_width; i += stride) {
+                    if (film.sample_count(i, j) == 0)
+                        render_pixel(world, film, i, j, 1);
+                }
+            });
+
+            submit_image(writer, film.upsampled(stride));
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            std::clog << "1/" << stride * stride << " resolution preview after " << elapsed.count() << " ms\n";
+        }
+    }
+
+    void render_noisiest(const hittable &world, accumulation_buffer &film, double fraction,
+                         std::chrono::steady_clock::time_point deadline) {
+        // Adds samples_per_pass samples to the given fraction of pixels with the largest
+        // relative error, visiting them in scanline order.
+        std::vector<std::pair<double, int>> errors;
+        errors.reserve(film.samples.size());
+        for (int j = 0; j < image_height; ++j)
+            for (int i = 0; i < image_width; ++i)
+                errors.emplace_back(film.relative_error(i, j), j * image_width + i);
+
+        auto count = std::max<size_t>(1, static_cast<size_t>(fraction * errors.size()));
+        std::nth_element(errors.begin(), errors.begin() + (count - 1), errors.end(),
+                         [](const auto &a, const auto &b) { return a.first > b.first; });
+
+        std::vector<int> pixels;
+        pixels.reserve(count);
+        for (size_t k = 0; k < count; ++k)
+            pixels.push_back(errors[k].second);
+        std::sort(pixels.begin(), pixels.end());
+
+        // Jobs of 64 pixels; those not started before the deadline are skipped.
+        const size_t job_size = 64;
+        run_pixel_jobs((pixels.size() + job_size - 1) / job_size, [&](size_t job, int) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return;
+            auto end = std::min(pixels.size(), (job + 1) * job_size);
+            for (auto k = job * job_size; k < end; ++k) {
+                auto i = pixels[k] % image_width;
+                auto j = pixels[k] / image_width;
+                render_pixel(world, film, i, j, film.sample_count(i, j) + samples_per_pass);
+            }
+        });
+    }
+
+    template<typename Work>
+    void run_pixel_jobs(size_t count, Work work) const {
+        // run_jobs on thread_count workers, each drawing from its own copy of
+        // pixel_sampler while it runs work(k, worker).
+        auto workers = worker_count(thread_count);
+        std::vector<shared_ptr<sampler>> samplers(workers);
+        run_jobs(count, workers, [&](int worker) {
+            samplers[worker] = pixel_sampler->clone();
+        }, [&](size_t k, int worker) {
+            active_sampler() = samplers[worker].get();
+            work(k, worker);
+            active_sampler() = nullptr;
+        });
+    }
+
+    void submit_image(image_writer &writer, const accumulation_buffer &film) const {
+        // Resolves the film now and leaves encoding and writing to the writer thread.
+        writer.submit([image = film.resolve(), path = output_file, settings = tone] {
+            write_image(path, image, settings);
+        });
+    }
+
+    void render_pixel(const hittable &world, accumulation_buffer &film, int i, int j, int end_sample,
+                      aov_buffer *aovs = nullptr) const {
+        // Draws from the active sampler, which is pixel_sampler or a worker's copy of it.
+        RT_TIME_PHASE(trace);
+        for (int sample = film.sample_count(i, j); sample < end_sample; ++sample) {
+            active_sampler()->start_pixel_sample(i, j, sample);
+            ray r = get_ray(i, j);
+            film.add_sample(i, j, camera_ray_color(r, i, j, world, aovs));
+        }
+    }
+
+    void render_pixel_filtered(const hittable &world, splat_film &film, int i, int j, aov_buffer *aovs) const {
+        // All samples of pixel (i, j), each splatted around the point it was taken at.
+        RT_TIME_PHASE(trace);
+        for (int sample = 0; sample < samples_per_pixel; ++sample) {
+            active_sampler()->start_pixel_sample(i, j, sample);
+            double offset_x, offset_y;
+            ray r = get_ray(i, j, offset_x, offset_y);
+            film.splat(i + offset_x, j + offset_y, camera_ray_color(r, i, j, world, aovs), filter);
+        }
+    }
+
+    color camera_ray_color(const ray &r, int i, int j, const hittable &world, aov_buffer *aovs) const {
+        // ray_color for the camera ray of pixel (i, j). With aovs its first hit is also
+        // recorded there; it is the hit ray_color would have found, so the color is the same.
+        if (!aovs || max_depth <= 0)
+            return ray_color(r, max_depth, world);
+
+        RT_COUNT_RAYS(0, 1);
+        hit_record rec;
+        if (!world.hit(r, interval(0.001, infinity), rec)) {
+            aovs->add_miss(i, j, background);
+            return background;
+        }
+        aovs->add_hit(i, j, r, rec);
+        return shade(r, rec, max_depth, world);
+    }
+
+    color preview_color(const ray &r, int depth, const hittable &world) const {
+        // Whitted-style shading: mirrors and glass are followed by scattering, every
+        // other surface is lit directly by the point light and the area lights.
+        hit_record rec;
+
+        if (depth <= 0)
+            return color(0, 0, 0);
+
+        RT_COUNT_RAYS(max_depth - depth, 1);
+        if (!world.hit(r, interval(0.001, infinity), rec))
+            return background;
+
+        if (rec.mat->is_specular())
+            return preview_specular(r, rec, depth, world);
+
+        // Point light: the shadow ray reaches the light at t = 1.
+        auto light_visible = false;
+        if (light_color.length_squared() > 0) {
+            hit_record blocker;
+            RT_COUNT(shadow_rays);
+            light_visible = !world.hit(ray(rec.p, light - rec.p), interval(0.001, 1 - 0.0001), blocker);
+        }
+        return preview_direct(r, rec, light_visible, world);
+    }
+
+    color preview_specular(const ray &r, const hit_record &rec, int depth, const hittable &world) const {
+        color result = rec.mat->emitted(rec.u, rec.v, rec.p);
+        ray scattered;
+        color attenuation;
+        if (rec.mat->scatter(r, rec, attenuation, scattered))
+            result += attenuation * preview_color(scattered, depth - 1, world);
+        return result;
+    }
+
+    color preview_direct(const ray &r, const hit_record &rec, bool light_visible, const hittable &world) const {
+        // Emission plus direct light at a non-specular hit; light_visible tells whether
+        // the shadow ray to the point light got through.
+        color result = rec.mat->emitted(rec.u, rec.v, rec.p);
+        auto view_direction = -unit_vector(r.direction());
+
+        if (light_visible)
+            result += rec.mat->shade_direct(rec, unit_vector(light - rec.p), view_direction, light_color);
+
+        // Area lights, approximated by a point at the centre of their bounds. The light is
+        // visible if the shadow ray first hits an emitter, whose radiance is then scaled
+        // by the solid angle the light covers (over pi).
+        for (const auto &object: lights.objects) {
+            auto box = object->bounding_box();
+            auto center = point3(box.x.min + box.x.max, box.y.min + box.y.max, box.z.min + box.z.max) / 2;
+            auto to_light = center - rec.p;
+
+            hit_record light_rec;
+            RT_COUNT(shadow_rays);
+            if (!world.hit(ray(rec.p, to_light), interval(0.001, infinity), light_rec))
+                continue;
+            auto radiance = light_rec.mat->emitted(light_rec.u, light_rec.v, light_rec.p);
+            if (radiance.length_squared() == 0)
+                continue;
+
+            auto radius = fmax(box.x.size(), fmax(box.y.size(), box.z.size())) / 2;
+            auto coverage = fmin(1.0, radius * radius / to_light.length_squared());
+            result += rec.mat->shade_direct(rec, unit_vector(to_light), view_direction, coverage * radiance);
+        }
+
+        return result;
+    }
+
+    color packet_lane_color(const ray &r, const hittable *object, const hittable &world) const {
+        // Builds the full hit record on the primitive the packet found closest
+        // and follows the rest of the path with single rays.
+        RT_COUNT_RAYS(0, 1);
+        hit_record rec;
+        if (!object || !object->hit(r, interval(0.001, infinity), rec))
+            return background;
+        return shade(r, rec, max_depth, world);
+    }
+
     ray get_ray(int i, int j) const {
+        double offset_x, offset_y;
+        return get_ray(i, j, offset_x, offset_y);
+    }
+
+    ray get_ray(int i, int j, double &offset_x, double &offset_y) const {
         // Get a randomly-sampled camera ray for the pixel at location i,j, originating from
-        // the camera defocus disk.
+        // the camera defocus disk. The offset of the sample from the pixel centre, in
+        // pixels, is returned for reconstruction filters.
+        RT_COUNT(camera_rays);
         auto pixel_center = pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v);
-        auto pixel_sample = pixel_center + pixel_sample_square();
+        auto pixel_sample = pixel_center + pixel_sample_square(offset_x, offset_y);
 
-        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+        // The lens dimensions are always drawn so the bounce dimensions do not shift.
+        auto lens_sample = defocus_disk_sample();
+        auto ray_origin = (defocus_angle <= 0) ? center : lens_sample;
         auto ray_direction = pixel_sample - ray_origin;
 
         return ray(ray_origin, ray_direction);
     }
 
-    vec3 pixel_sample_square() const {
+    vec3 pixel_sample_square(double &px, double &py) const {
         // Returns a random point in the square surrounding a pixel at the origin.
-        auto px = -0.5 + random_double();
-        auto py = -0.5 + random_double();
+        sample_2d(px, py);
+        px -= 0.5;
+        py -= 0.5;
         return (px * pixel_delta_u) + (py * pixel_delta_v);
     }
 
     point3 defocus_disk_sample() const {
         // Returns a random point in the camera defocus disk.
-        auto p = random_in_unit_disk();
+        auto p = sampled_in_unit_disk();
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
@@ -132,10 +1027,17 @@ private:
         if (depth <= 0)
             return color(0, 0, 0);
 
+        RT_COUNT_RAYS(max_depth - depth, 1);
+
         // If the ray hits nothing, return the background color.
         if (!world.hit(r, interval(0.001, infinity), rec))
             return background;
 
+        return shade(r, rec, depth, world);
+    }
+
+    color shade(const ray &r, const hit_record &rec, int depth, const hittable &world) const {
+        // Light leaving the hit point back along r: emission plus the scattered path.
         ray scattered;
         color attenuation;
         color color_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);
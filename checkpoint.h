@@ -0,0 +1,139 @@
+#ifndef RAYTRACER_CHECKPOINT_H
+#define RAYTRACER_CHECKPOINT_H
+
+#include "accumulation_buffer.h"
+#include "sampler.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Binary snapshot of a progressive render, in native byte order:
+//   magic "RTCK", version, width, height, sampler seed, sampler name length + name,
+//   sampler parameter (e.g. the strata, see sampler::parameter),
+//   then per pixel the three linear sums (double), then the sums of squared luminance
+//   (double) and finally all sample counts (int32).
+// Samplers are pure functions of (pixel, sample index, dimension, seed), so the seed,
+// the parameter and the sample counts are all the sampler state needed to continue a
+// render exactly where it stopped.
+
+const uint32_t checkpoint_version = 3;
+
+inline bool save_checkpoint(const std::string &path, const accumulation_buffer &film, const sampler &s) {
+    auto temporary_path = path + ".tmp";
+    std::ofstream file(temporary_path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot write checkpoint " << temporary_path << '\n';
+        return false;
+    }
+
+    auto put = [&file](const auto &value) {
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+
+    file.write("RTCK", 4);
+    put(checkpoint_version);
+    put(static_cast<int32_t>(film.width));
+    put(static_cast<int32_t>(film.height));
+    put(s.seed);
+
+    auto name = s.name();
+    put(static_cast<uint32_t>(name.size()));
+    file.write(name.data(), static_cast<std::streamsize>(name.size()));
+    put(s.parameter());
+
+    file.write(reinterpret_cast<const char *>(film.sum.data()),
+               static_cast<std::streamsize>(film.sum.size() * sizeof(color)));
+    file.write(reinterpret_cast<const char *>(film.sum_squares.data()),
+               static_cast<std::streamsize>(film.sum_squares.size() * sizeof(double)));
+    for (auto count: film.samples)
+        put(static_cast<int32_t>(count));
+
+    file.close();
+    if (!file) {
+        std::cerr << "Failed writing checkpoint " << temporary_path << '\n';
+        return false;
+    }
+
+    return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+inline bool load_checkpoint(const std::string &path, accumulation_buffer &film, sampler &s) {
+    // Restores the film and the sampler seed and parameter. The film must already have
+    // the size of the render being resumed, and the sampler must be of the kind that
+    // was saved.
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot open checkpoint " << path << '\n';
+        return false;
+    }
+
+    auto get = [&file](auto &value) {
+        file.read(reinterpret_cast<char *>(&value), sizeof(value));
+    };
+
+    char magic[4];
+    file.read(magic, 4);
+    uint32_t version = 0;
+    get(version);
+    if (!file || std::string(magic, 4) != "RTCK") {
+        std::cerr << path << " is not a checkpoint\n";
+        return false;
+    }
+    // Older files lack the sums of squares (version 1) or the sampler parameter
+    // (version 2), so they cannot be resumed exactly.
+    if (version != checkpoint_version) {
+        std::cerr << "Checkpoint version " << version << " is not supported (expected " << checkpoint_version
+                  << "): " << path << '\n';
+        return false;
+    }
+
+    int32_t width, height;
+    uint32_t seed, name_length;
+    get(width);
+    get(height);
+    get(seed);
+    get(name_length);
+    // Sampler names are short; a larger length means the file is damaged.
+    if (!file || name_length > 256) {
+        std::cerr << "Checkpoint " << path << " is corrupt\n";
+        return false;
+    }
+    std::string name(name_length, '\0');
+    file.read(name.data(), name_length);
+    uint32_t parameter = 0;
+    get(parameter);
+
+    if (width != film.width || height != film.height) {
+        std::cerr << "Checkpoint is " << width << 'x' << height << ", render is "
+                  << film.width << 'x' << film.height << '\n';
+        return false;
+    }
+    if (name != s.name()) {
+        std::cerr << "Checkpoint was rendered with the " << name << " sampler, not " << s.name() << '\n';
+        return false;
+    }
+
+    file.read(reinterpret_cast<char *>(film.sum.data()),
+              static_cast<std::streamsize>(film.sum.size() * sizeof(color)));
+    file.read(reinterpret_cast<char *>(film.sum_squares.data()),
+              static_cast<std::streamsize>(film.sum_squares.size() * sizeof(double)));
+    for (auto &count: film.samples) {
+        int32_t stored;
+        get(stored);
+        count = stored;
+    }
+
+    if (!file) {
+        std::cerr << "Checkpoint " << path << " is truncated\n";
+        return false;
+    }
+
+    s.seed = seed;
+    s.set_parameter(parameter);
+    return true;
+}
+
+#endif //RAYTRACER_CHECKPOINT_H
@@ -3,35 +3,11 @@
 
 #include "vec3.h"
 
-#include <iostream>
-
 using color = vec3;
 
-inline double linear_to_gamma(double linear_component) {
-    return sqrt(linear_component);
-}
-
-void write_color(std::ostream &out, color pixel_color, int samples_per_pixel) {
-    auto r = pixel_color.x();
-    auto g = pixel_color.y();
-    auto b = pixel_color.z();
-
-    // Divide the color by the number of samples.
-    auto scale = 1.0 / samples_per_pixel;
-    r *= scale;
-    g *= scale;
-    b *= scale;
-
-    // Apply the linear to gamma transform.
-    r = linear_to_gamma(r);
-    g = linear_to_gamma(g);
-    b = linear_to_gamma(b);
-
-    // Write the translated [0,255] value of each color component.
-    static const interval intensity(0.000, 0.999);
-    out << static_cast<int>(256 * intensity.clamp(r)) << ' '
-        << static_cast<int>(256 * intensity.clamp(g)) << ' '
-        << static_cast<int>(256 * intensity.clamp(b)) << '\n';
+inline double luminance(const color &c) {
+    // Rec. 709 weights of linear RGB.
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
 }
 
 #endif //RAYTRACER_COLOR_H
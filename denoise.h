@@ -0,0 +1,144 @@
+#ifndef RAYTRACER_DENOISE_H
+#define RAYTRACER_DENOISE_H
+
+#include "framebuffer.h"
+#include "stats.h"
+#include "tile_pool.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+struct denoise_settings {
+    int iterations = 5;         // A-trous passes; the filter spans 4 * 2^iterations pixels
+    float sigma_color = 1.0f;   // Tolerated relative difference of demodulated color, halved every pass
+    float sigma_normal = 0.25f; // Tolerated difference of unit normals
+    float sigma_depth = 0.05f;  // Tolerated depth difference, relative to the depth
+    int thread_count = 0;       // Worker threads (0 = one per core)
+};
+
+inline float denoise_exp_neg(float x) {
+    // exp(-x) as (1 + x/16)^-16: only multiplies and a divide, so the loops using it
+    // vectorize. Edge-stopping weights do not need more precision than this.
+    auto t = 1.0f + x * (1.0f / 16);
+    t *= t;
+    t *= t;
+    t *= t;
+    t *= t;
+    return 1.0f / t;
+}
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010). Every pass blurs with a
+// 5x5 B3-spline kernel whose taps are 2^pass pixels apart, weighting each tap by how
+// similar its color, normal and depth are to the centre pixel, so the blur stops at
+// geometric and shading edges. Color differences are taken relative to the brightness
+// of the two pixels, so that lone bright samples in dark regions still get spread out.
+// Color is divided by the albedo first and multiplied back at the end, which keeps
+// texture detail out of the blur. Guides are the AOVs of aov_buffer: normal with zero
+// length and depth zero where nothing was hit.
+// Rows are split over a worker pool, and each kernel tap is applied to a whole row as
+// one contiguous loop over planar arrays so that it vectorizes.
+inline framebuffer denoise(const framebuffer &noisy, const framebuffer &albedo, const framebuffer &normal,
+                           const framebuffer &depth, const denoise_settings &settings = {}) {
+    RT_TIME_PHASE(denoise);
+    auto width = noisy.width;
+    auto height = noisy.height;
+    auto count = static_cast<size_t>(width) * height;
+
+    // Planar copies: three color planes that ping-pong between passes, the guides.
+    std::vector<float> color[3], filtered[3], modulation[3], n[3], z(count);
+    for (int c = 0; c < 3; ++c) {
+        color[c].resize(count);
+        filtered[c].resize(count);
+        modulation[c].resize(count);
+        n[c].resize(count);
+    }
+    for (size_t k = 0; k < count; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            // Channels without albedo (emitters, background) are filtered as they are.
+            auto a = albedo.data[3 * k + c];
+            modulation[c][k] = a > 0.01f ? a : 1.0f;
+            color[c][k] = noisy.data[3 * k + c] / modulation[c][k];
+            n[c][k] = normal.data[3 * k + c];
+        }
+        z[k] = depth.data[3 * k];
+    }
+
+    static const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+    auto workers = worker_count(settings.thread_count);
+    auto inv_normal = 1.0f / (settings.sigma_normal * settings.sigma_normal);
+    auto inv_depth = 1.0f / settings.sigma_depth;
+
+    for (int pass = 0; pass < settings.iterations; ++pass) {
+        auto step = 1 << pass;
+        auto sigma_color = settings.sigma_color / static_cast<float>(1 << pass);
+        auto inv_color = 1.0f / (sigma_color * sigma_color);
+
+        run_jobs(static_cast<size_t>(height), workers, [](int) {}, [&](size_t row, int) {
+            auto y = static_cast<int>(row);
+            auto base = row * width;
+            std::vector<float> sum[3], weight_sum(width, 0.0f);
+            for (auto &s: sum)
+                s.assign(width, 0.0f);
+
+            const float *cr = &color[0][base], *cg = &color[1][base], *cb = &color[2][base];
+            const float *nx = &n[0][base], *ny = &n[1][base], *nz = &n[2][base];
+            const float *zp = &z[base];
+
+            for (int ty = 0; ty < 5; ++ty) {
+                auto yq = y + (ty - 2) * step;
+                if (yq < 0 || yq >= height)
+                    continue;
+                for (int tx = 0; tx < 5; ++tx) {
+                    // Taps outside the image are skipped; the weights are renormalized.
+                    auto dx = (tx - 2) * step;
+                    auto x0 = std::max(0, -dx), x1 = std::min(width, width - dx);
+                    auto h = kernel[tx] * kernel[ty];
+                    auto q = static_cast<size_t>(yq) * width;
+                    const float *qr = &color[0][q], *qg = &color[1][q], *qb = &color[2][q];
+                    const float *qnx = &n[0][q], *qny = &n[1][q], *qnz = &n[2][q];
+                    const float *qz = &z[q];
+                    float *sr = sum[0].data(), *sg = sum[1].data(), *sb = sum[2].data();
+                    float *sw = weight_sum.data();
+
+                    #pragma omp simd
+                    for (int x = x0; x < x1; ++x) {
+                        auto dr = cr[x] - qr[x + dx], dg = cg[x] - qg[x + dx], db = cb[x] - qb[x + dx];
+                        auto ex = nx[x] - qnx[x + dx], ey = ny[x] - qny[x + dx], ez = nz[x] - qnz[x + dx];
+                        auto dz = zp[x] - qz[x + dx];
+                        auto relative_depth = (dz < 0 ? -dz : dz) / (zp[x] + 1e-3f);
+                        auto brightness = 1.0f + (cr[x] + cg[x] + cb[x] + qr[x + dx] + qg[x + dx] + qb[x + dx]) / 3;
+                        auto w = h * denoise_exp_neg((dr * dr + dg * dg + db * db) / (brightness * brightness) * inv_color
+                                                     + (ex * ex + ey * ey + ez * ez) * inv_normal
+                                                     + relative_depth * inv_depth);
+                        sr[x] += w * qr[x + dx];
+                        sg[x] += w * qg[x + dx];
+                        sb[x] += w * qb[x + dx];
+                        sw[x] += w;
+                    }
+                }
+            }
+
+            // The centre tap always has weight h > 0, so the sum is never zero.
+            for (int c = 0; c < 3; ++c) {
+                float *out = &filtered[c][base];
+                const float *s = sum[c].data();
+                const float *w = weight_sum.data();
+                #pragma omp simd
+                for (int x = 0; x < width; ++x)
+                    out[x] = s[x] / w[x];
+            }
+        });
+
+        for (int c = 0; c < 3; ++c)
+            std::swap(color[c], filtered[c]);
+    }
+
+    framebuffer result(width, height);
+    for (size_t k = 0; k < count; ++k)
+        for (int c = 0; c < 3; ++c)
+            result.data[3 * k + c] = color[c][k] * modulation[c][k];
+    return result;
+}
+
+#endif //RAYTRACER_DENOISE_H
@@ -0,0 +1,139 @@
+#ifndef RAYTRACER_FILTER_H
+#define RAYTRACER_FILTER_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+enum class filter_kind {
+    box,            // Average of the samples inside the pixel, no splatting
+    gaussian,       // Standard deviation of half a pixel
+    mitchell,       // Mitchell-Netravali with B = C = 1/3
+    blackman_harris // Four-term Blackman-Harris window
+};
+
+// Separable pixel reconstruction filter: a sample at offset (x, y) from a pixel centre
+// counts towards that pixel with weight evaluate(x) * evaluate(y).
+class pixel_filter {
+public:
+    filter_kind kind = filter_kind::box;
+    double radius = 0.5; // Pixels from the centre to the edge of the footprint
+
+    pixel_filter() {}
+
+    explicit pixel_filter(filter_kind _kind) : kind(_kind) {
+        radius = kind == filter_kind::box ? 0.5 : kind == filter_kind::gaussian ? 1.5 : 2.0;
+    }
+
+    double evaluate(double x) const {
+        x = fabs(x);
+        if (x >= radius)
+            return 0;
+        switch (kind) {
+            case filter_kind::gaussian: {
+                const double sigma = 0.5;
+                auto gauss = [&](double d) { return exp(-d * d / (2 * sigma * sigma)); };
+                return gauss(x) - gauss(radius);
+            }
+            case filter_kind::mitchell:
+                return mitchell(2 * x / radius);
+            case filter_kind::blackman_harris: {
+                auto t = 2 * pi * (0.5 + x / (2 * radius));
+                return 0.35875 - 0.48829 * cos(t) + 0.14128 * cos(2 * t) - 0.01168 * cos(3 * t);
+            }
+            default:
+                return 1;
+        }
+    }
+
+private:
+    static double mitchell(double x) {
+        // Mitchell-Netravali on [0, 2] with B = C = 1/3.
+        const double b = 1.0 / 3, c = 1.0 / 3;
+        if (x < 1)
+            return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6;
+        return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6;
+    }
+};
+
+// Filter-weighted sums for a window of the image starting at pixel (x0, y0). A tile
+// renders into its own window, grown by the filter footprint on every side, so its
+// samples can splat into neighbouring tiles' pixels without touching shared memory;
+// the window is then added to the whole-image film in one merge.
+class splat_film {
+public:
+    int x0 = 0, y0 = 0;
+    int width = 0, height = 0;
+    std::vector<color> sum;
+    std::vector<double> weight;
+
+    splat_film() {}
+
+    splat_film(int _x0, int _y0, int _width, int _height)
+            : x0(_x0), y0(_y0), width(_width), height(_height),
+              sum(static_cast<size_t>(_width) * _height), weight(sum.size(), 0.0) {}
+
+    void splat(double x, double y, const color &c, const pixel_filter &filter) {
+        // Adds a sample at image position (x, y), where pixel (i, j) has its centre at
+        // (i, j), to every pixel of the window within the filter radius.
+        auto i0 = std::max(x0, static_cast<int>(ceil(x - filter.radius)));
+        auto i1 = std::min(x0 + width - 1, static_cast<int>(floor(x + filter.radius)));
+        auto j0 = std::max(y0, static_cast<int>(ceil(y - filter.radius)));
+        auto j1 = std::min(y0 + height - 1, static_cast<int>(floor(y + filter.radius)));
+        i1 = std::min(i1, i0 + 15); // Footprints are at most 16 pixels wide
+
+        double wx[16];
+        for (int i = i0; i <= i1; ++i)
+            wx[i - i0] = filter.evaluate(i - x);
+
+        for (int j = j0; j <= j1; ++j) {
+            auto wy = filter.evaluate(j - y);
+            if (wy == 0)
+                continue;
+            for (int i = i0; i <= i1; ++i) {
+                auto index = pixel_index(i, j);
+                auto w = wx[i - i0] * wy;
+                sum[index] += w * c;
+                weight[index] += w;
+            }
+        }
+    }
+
+    void merge(const splat_film &tile) {
+        // Adds the overlapping part of another window.
+        auto i0 = std::max(x0, tile.x0), i1 = std::min(x0 + width, tile.x0 + tile.width);
+        auto j0 = std::max(y0, tile.y0), j1 = std::min(y0 + height, tile.y0 + tile.height);
+        for (int j = j0; j < j1; ++j) {
+            for (int i = i0; i < i1; ++i) {
+                sum[pixel_index(i, j)] += tile.sum[tile.pixel_index(i, j)];
+                weight[pixel_index(i, j)] += tile.weight[tile.pixel_index(i, j)];
+            }
+        }
+    }
+
+    color estimate(int i, int j) const {
+        // Filters with negative lobes can leave a tiny total weight; treat that as empty.
+        auto index = pixel_index(i, j);
+        return weight[index] > 1e-8 ? sum[index] / weight[index] : color(0, 0, 0);
+    }
+
+    framebuffer resolve() const {
+        framebuffer image(width, height);
+        for (int j = 0; j < height; ++j)
+            for (int i = 0; i < width; ++i)
+                image.set(i, j, estimate(x0 + i, y0 + j));
+        return image;
+    }
+
+private:
+    size_t pixel_index(int i, int j) const {
+        return static_cast<size_t>(j - y0) * width + (i - x0);
+    }
+};
+
+#endif //RAYTRACER_FILTER_H
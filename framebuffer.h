@@ -0,0 +1,45 @@
+#ifndef RAYTRACER_FRAMEBUFFER_H
+#define RAYTRACER_FRAMEBUFFER_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+
+#include <vector>
+
+// Finished image in memory: linear RGB as three floats per pixel, rows top to bottom.
+// Renders resolve their samples into one and the encoders in image_io.h turn it into
+// a file in a single pass, so no formatting happens while tracing.
+class framebuffer {
+public:
+    int width = 0;
+    int height = 0;
+    std::vector<float> data;
+
+    framebuffer() {}
+
+    framebuffer(int _width, int _height)
+            : width(_width), height(_height), data(static_cast<size_t>(_width) * _height * 3, 0.0f) {}
+
+    float *pixel(int i, int j) {
+        return &data[(static_cast<size_t>(j) * width + i) * 3];
+    }
+
+    const float *pixel(int i, int j) const {
+        return &data[(static_cast<size_t>(j) * width + i) * 3];
+    }
+
+    void set(int i, int j, const color &c) {
+        auto p = pixel(i, j);
+        p[0] = static_cast<float>(c.x());
+        p[1] = static_cast<float>(c.y());
+        p[2] = static_cast<float>(c.z());
+    }
+
+    color get(int i, int j) const {
+        auto p = pixel(i, j);
+        return color(p[0], p[1], p[2]);
+    }
+};
+
+#endif //RAYTRACER_FRAMEBUFFER_H
@@ -0,0 +1,75 @@
+#ifndef RAYTRACER_HEATMAP_H
+#define RAYTRACER_HEATMAP_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+#include "framebuffer.h"
+#include "image_io.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+inline color heat_color(double t) {
+    // Turbo colormap (polynomial fit by Mikhailov): dark blue at 0 through green and
+    // yellow to dark red at 1, in display values.
+    t = std::clamp(t, 0.0, 1.0);
+    auto r = 0.13572138 + t * (4.61539260 + t * (-42.66032258 + t * (132.13108234 + t * (-152.94239396 + t * 59.28637943))));
+    auto g = 0.09140261 + t * (2.19418839 + t * (4.84296658 + t * (-14.18503333 + t * (4.27729857 + t * 2.82956604))));
+    auto b = 0.10667330 + t * (12.64194608 + t * (-60.58204836 + t * (110.36276771 + t * (-89.90310912 + t * 27.34824973))));
+    return color(std::clamp(r, 0.0, 1.0), std::clamp(g, 0.0, 1.0), std::clamp(b, 0.0, 1.0));
+}
+
+// Per-pixel cost of a render, e.g. seconds spent or intersection tests done, shown as
+// a heatmap to find the expensive regions of a frame. Every pixel is written by one
+// tile only, so workers can add to it without locking.
+class cost_buffer {
+public:
+    int width = 0;
+    int height = 0;
+    std::vector<double> cost;
+
+    cost_buffer() {}
+
+    cost_buffer(int _width, int _height)
+            : width(_width), height(_height), cost(static_cast<size_t>(_width) * _height, 0.0) {}
+
+    void add(int i, int j, double amount) {
+        cost[static_cast<size_t>(j) * width + i] += amount;
+    }
+
+    double scale() const {
+        // The 99th percentile maps to the top of the colormap, so a few outliers do
+        // not leave the rest of the frame dark blue.
+        if (cost.empty())
+            return 0;
+        auto sorted = cost;
+        auto top = sorted.begin() + static_cast<long>((sorted.size() - 1) * 0.99);
+        std::nth_element(sorted.begin(), top, sorted.end());
+        return *top;
+    }
+
+    framebuffer colorize(double full_scale) const {
+        // The colormap is squared into linear values, which the default gamma 2 output
+        // turns back into the colormap.
+        framebuffer image(width, height);
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                auto t = full_scale > 0 ? cost[static_cast<size_t>(j) * width + i] / full_scale : 0.0;
+                auto c = heat_color(t);
+                image.set(i, j, c * c);
+            }
+        }
+        return image;
+    }
+
+    bool write(const std::string &path, const char *unit) const {
+        auto full_scale = scale();
+        std::clog << "\rHeatmap " << path << ": red is " << full_scale << ' ' << unit << " per pixel\n";
+        return write_image(path, colorize(full_scale));
+    }
+};
+
+#endif //RAYTRACER_HEATMAP_H
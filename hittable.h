@@ -3,13 +3,18 @@
 
 #include "rtweekend.h"
 
+#include "aabb.h"
+#include "ray_packet.h"
+
 class material;
+class hittable;
 
 class hit_record {
 public:
     point3 p;
     vec3 normal;
     shared_ptr<material> mat;
+    const hittable *object = nullptr; // Primitive that was hit
     double t;
     bool front_face;
     double u;
@@ -29,7 +34,35 @@ public:
     virtual ~hittable() = default;
 
     virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0;
+
+    virtual aabb bounding_box() const = 0;
+
+    // Finds, for every active lane, a hit closer than hits.t[lane] and records its t
+    // and the primitive. This fallback traces the lanes one by one; primitives
+    // override it with vectorized tests.
+    virtual void hit_packet(const ray_packet &rays, double t_min, packet_hit &hits) const {
+        hit_record rec;
+        for (int k = 0; k < packet_width; ++k) {
+            if (rays.active[k] && hit(rays.lane(k), interval(t_min, hits.t[k]), rec)) {
+                hits.t[k] = rec.t;
+                hits.object[k] = this;
+            }
+        }
+    }
 };
 
+inline void packet_occluded(const hittable &world, const ray_packet &rays, bool *occluded) {
+    // Shadow rays run from the shading point with direction (light - point), so the
+    // light sits at t = 1 and anything hit before it blocks the lane. Hits closer
+    // than 0.001 are ignored, as for the single shadow rays of camera::preview_color.
+    packet_hit hits;
+    for (int k = 0; k < packet_width; ++k) {
+        hits.t[k] = 1 - 0.0001;
+        hits.object[k] = nullptr;
+    }
+    world.hit_packet(rays, 0.001, hits);
+    for (int k = 0; k < packet_width; ++k)
+        occluded[k] = rays.active[k] && hits.object[k] != nullptr;
+}
 
 #endif //RAYTRACER_HITTABLE_H
@@ -17,10 +17,14 @@ public:
 
     hittable_list(shared_ptr<hittable> object) { add(object); }
 
-    void clear() { objects.clear(); }
+    void clear() {
+        objects.clear();
+        bbox = aabb();
+    }
 
     void add(shared_ptr<hittable> object) {
         objects.push_back(object);
+        bbox = aabb(bbox, object->bounding_box());
     }
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
@@ -38,6 +42,20 @@ public:
 
         return hit_anything;
     }
+
+    aabb bounding_box() const override { return bbox; }
+
+    void hit_packet(const ray_packet &rays, double t_min, packet_hit &hits) const override {
+        // Skip the whole list when no lane can reach its bounds before its closest hit.
+        if (!bbox.hit_packet(rays, t_min, hits.t))
+            return;
+
+        for (const auto &object: objects)
+            object->hit_packet(rays, t_min, hits);
+    }
+
+private:
+    aabb bbox;
 };
 
 #endif //RAYTRACER_HITTABLE_LIST_H
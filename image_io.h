@@ -0,0 +1,241 @@
+#ifndef RAYTRACER_IMAGE_IO_H
+#define RAYTRACER_IMAGE_IO_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+#include "framebuffer.h"
+#include "stats.h"
+#include "tone_map.h"
+
+#include <SFML/Graphics.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// 8-bit RGB image, rows top to bottom, three bytes per pixel.
+struct rgb_image {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> data;
+
+    rgb_image() {}
+
+    rgb_image(int _width, int _height)
+            : width(_width), height(_height), data(static_cast<size_t>(_width) * _height * 3, 0) {}
+
+    unsigned char *pixel(int i, int j) {
+        return &data[(static_cast<size_t>(j) * width + i) * 3];
+    }
+};
+
+inline bool read_ppm_token(std::istream &in, int &value) {
+    // Reads the next header number, skipping whitespace and # comments.
+    in >> std::ws;
+    while (in.peek() == '#') {
+        std::string comment;
+        std::getline(in, comment);
+        in >> std::ws;
+    }
+    return static_cast<bool>(in >> value);
+}
+
+inline bool read_ppm(const std::string &path, rgb_image &image) {
+    // Reads ASCII (P3) and binary (P6) PPM files with a maximum value of 255.
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    std::string magic;
+    file >> magic;
+    int width, height, max_value;
+    if ((magic != "P3" && magic != "P6")
+        || !read_ppm_token(file, width) || !read_ppm_token(file, height) || !read_ppm_token(file, max_value)
+        || width <= 0 || height <= 0 || max_value != 255) {
+        std::cerr << path << " is not an 8-bit PPM image\n";
+        return false;
+    }
+
+    image = rgb_image(width, height);
+    if (magic == "P6") {
+        file.get(); // Single whitespace character after the header
+        file.read(reinterpret_cast<char *>(image.data.data()), static_cast<std::streamsize>(image.data.size()));
+    } else {
+        for (auto &value: image.data) {
+            int component;
+            file >> component;
+            value = static_cast<unsigned char>(component);
+        }
+    }
+
+    if (!file) {
+        std::cerr << path << " is truncated\n";
+        return false;
+    }
+    return true;
+}
+
+inline rgb_image to_rgb_image(const framebuffer &image, const tone_settings &tone) {
+    // 8-bit display values of a linear framebuffer.
+    rgb_image result(image.width, image.height);
+    tone_map(image, tone, result.data.data());
+    return result;
+}
+
+inline std::string path_stem(const std::string &path) {
+    // path without its extension, if it has one.
+    auto dot = path.find_last_of('.');
+    auto slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path;
+    return path.substr(0, dot);
+}
+
+inline std::string temporary_path(const std::string &path) {
+    // Sibling of path with the same extension (SFML picks the format by it), which is
+    // renamed over path once complete so readers never see a partial image.
+    auto stem = path_stem(path);
+    return stem + ".tmp" + path.substr(stem.size());
+}
+
+inline bool finish_write(const std::string &temporary, const std::string &path, bool written) {
+    if (!written) {
+        std::cerr << "Cannot write " << temporary << '\n';
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+inline bool has_extension(const std::string &path, const char *extension) {
+    auto length = std::strlen(extension);
+    return path.size() >= length && path.compare(path.size() - length, length, extension) == 0;
+}
+
+inline bool little_endian_host() {
+    uint32_t one = 1;
+    unsigned char first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+inline bool read_pfm(const std::string &path, framebuffer &image) {
+    // Reads colour portable float maps as written by pfm_encoder, in either byte order.
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    std::string magic;
+    int width, height;
+    double scale;
+    file >> magic >> width >> height >> scale;
+    if (magic != "PF" || !file || width <= 0 || height <= 0 || scale == 0) {
+        std::cerr << path << " is not a colour PFM image\n";
+        return false;
+    }
+    file.get(); // Single whitespace character after the header
+
+    image = framebuffer(width, height);
+    std::vector<char> row(static_cast<size_t>(width) * 3 * sizeof(float));
+    for (int j = height - 1; j >= 0 && file; --j) {
+        file.read(row.data(), static_cast<std::streamsize>(row.size()));
+        if ((scale < 0) != little_endian_host())
+            for (size_t k = 0; k < row.size(); k += 4)
+                std::swap(row[k], row[k + 3]), std::swap(row[k + 1], row[k + 2]);
+        std::memcpy(image.pixel(0, j), row.data(), row.size());
+    }
+
+    if (!file) {
+        std::cerr << path << " is truncated\n";
+        return false;
+    }
+    return true;
+}
+
+inline bool write_ppm(const std::string &path, const rgb_image &image) {
+    // Binary PPM (P6): the header and one block of bytes.
+    auto temporary = temporary_path(path);
+    std::ofstream file(temporary, std::ios::binary);
+    file << "P6\n" << image.width << ' ' << image.height << "\n255\n";
+    file.write(reinterpret_cast<const char *>(image.data.data()), static_cast<std::streamsize>(image.data.size()));
+    file.close();
+    return finish_write(temporary, path, static_cast<bool>(file));
+}
+
+// Writes a framebuffer to a file in one format. Encoders are picked by the extension
+// of the output path (see encoder_for); 8-bit formats apply the tone settings.
+class image_encoder {
+public:
+    virtual ~image_encoder() = default;
+
+    virtual bool write(const std::string &path, const framebuffer &image, const tone_settings &tone) const = 0;
+};
+
+class ppm_encoder : public image_encoder {
+public:
+    bool write(const std::string &path, const framebuffer &image, const tone_settings &tone) const override {
+        return write_ppm(path, to_rgb_image(image, tone));
+    }
+};
+
+class png_encoder : public image_encoder {
+public:
+    bool write(const std::string &path, const framebuffer &image, const tone_settings &tone) const override {
+        auto rgb = to_rgb_image(image, tone);
+        std::vector<sf::Uint8> rgba(rgb.data.size() / 3 * 4);
+        for (size_t k = 0, m = 0; k < rgb.data.size(); k += 3, m += 4) {
+            rgba[m + 0] = rgb.data[k + 0];
+            rgba[m + 1] = rgb.data[k + 1];
+            rgba[m + 2] = rgb.data[k + 2];
+            rgba[m + 3] = 255;
+        }
+
+        sf::Image png;
+        png.create(image.width, image.height, rgba.data());
+        auto temporary = temporary_path(path);
+        return finish_write(temporary, path, png.saveToFile(temporary));
+    }
+};
+
+class pfm_encoder : public image_encoder {
+public:
+    bool write(const std::string &path, const framebuffer &image, const tone_settings &) const override {
+        // Portable float map: linear 32-bit floats, unclamped and not tone mapped, so HDR
+        // values survive for re-grading (see read_pfm). Rows run bottom to top; the
+        // negative scale marks little endian.
+        auto temporary = temporary_path(path);
+        std::ofstream file(temporary, std::ios::binary);
+        file << "PF\n" << image.width << ' ' << image.height << "\n-1.0\n";
+
+        std::vector<char> row(static_cast<size_t>(image.width) * 3 * sizeof(float));
+        for (int j = image.height - 1; j >= 0; --j) {
+            std::memcpy(row.data(), image.pixel(0, j), row.size());
+            if (!little_endian_host())
+                for (size_t k = 0; k < row.size(); k += 4)
+                    std::swap(row[k], row[k + 3]), std::swap(row[k + 1], row[k + 2]);
+            file.write(row.data(), static_cast<std::streamsize>(row.size()));
+        }
+        file.close();
+        return finish_write(temporary, path, static_cast<bool>(file));
+    }
+};
+
+inline shared_ptr<image_encoder> encoder_for(const std::string &path) {
+    // .png and .pfm by extension, binary PPM for anything else.
+    if (has_extension(path, ".png"))
+        return make_shared<png_encoder>();
+    if (has_extension(path, ".pfm"))
+        return make_shared<pfm_encoder>();
+    return make_shared<ppm_encoder>();
+}
+
+inline bool write_image(const std::string &path, const framebuffer &image, const tone_settings &tone = {}) {
+    RT_TIME_PHASE(write);
+    return encoder_for(path)->write(path, image, tone);
+}
+
+#endif //RAYTRACER_IMAGE_IO_H
@@ -0,0 +1,72 @@
+#ifndef RAYTRACER_IMAGE_WRITER_H
+#define RAYTRACER_IMAGE_WRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Dedicated thread that encodes and writes finished frames or tiles, so render threads
+// never wait on the filesystem. Jobs run one at a time in submission order. The queue
+// holds at most capacity jobs; submit blocks while it is full, which bounds the memory
+// held by images waiting to be written.
+class image_writer {
+public:
+    explicit image_writer(size_t _capacity = 4) : capacity(_capacity), thread([this] { run(); }) {}
+
+    image_writer(const image_writer &) = delete;
+
+    image_writer &operator=(const image_writer &) = delete;
+
+    ~image_writer() {
+        finish();
+    }
+
+    void submit(std::function<void()> job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return queue.size() < capacity; });
+        queue.push_back(std::move(job));
+        not_empty.notify_one();
+    }
+
+    void finish() {
+        // Waits until every submitted job has run and stops the thread.
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+                return;
+            stopping = true;
+        }
+        not_empty.notify_one();
+        thread.join();
+    }
+
+private:
+    size_t capacity;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<std::function<void()>> queue;
+    bool stopping = false;
+    std::thread thread;
+
+    void run() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                not_empty.wait(lock, [this] { return !queue.empty() || stopping; });
+                if (queue.empty())
+                    return;
+                job = std::move(queue.front());
+                queue.pop_front();
+                not_full.notify_all();
+            }
+            job();
+        }
+    }
+};
+
+#endif //RAYTRACER_IMAGE_WRITER_H
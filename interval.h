@@ -9,6 +9,9 @@ public:
 
     interval(double _min, double _max) : min(_min), max(_max) {}
 
+    interval(const interval &a, const interval &b)
+            : min(fmin(a.min, b.min)), max(fmax(a.max, b.max)) {}
+
     bool contains(double x) const {
         return min <= x && x <= max;
     }
@@ -17,6 +20,15 @@ public:
         return min < x && x < max;
     }
 
+    double size() const {
+        return max - min;
+    }
+
+    interval expand(double delta) const {
+        auto padding = delta / 2;
+        return interval(min - padding, max + padding);
+    }
+
     // Ensure to stay within bounds
     double clamp(double x) const {
         if (x < min) return min;
@@ -6,9 +6,177 @@
 #include "material.h"
 #include "sphere.h"
 #include "objects.h"
+#include "viewer.h"
 
 
-int main() {
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+
+    bool progressive = false;
+    std::string checkpoint_file, resume_file;
+    int image_width = 800;
+    int samples_per_pixel = 500;
+    double time_budget = 0;
+    bool adaptive = false;
+    bool wavefront = false;
+    bool packets = false;
+    bool reorder = false;
+    bool preview = false;
+    bool coarse_to_fine = false;
+    std::vector<pixel_region> regions;
+    int strip_index = 0, strip_count = 0;
+    std::string composite_file;
+    bool interactive = false;
+    bool reprojection = true;
+    std::string sequence_file, frame_pattern = "frame_%04d.ppm";
+    int frame_count = 0;
+    std::string output_file = "../image2.ppm";
+    tone_settings tone;
+    std::string grade_file;
+    bool streamed = false;
+    bool write_aovs = false;
+    bool apply_denoiser = false;
+    bool write_heatmap = false;
+    pixel_filter filter;
+    std::string sampler_name = "sobol";
+    std::string shared_memory_name, snapshot_name;
+    bool stereo = false;
+    int turntable_views = 0;
+    for (int k = 1; k < argc; ++k) {
+        std::string arg = argv[k];
+        if (arg == "--progressive")
+            progressive = true;
+        else if (arg == "--checkpoint" && k + 1 < argc)
+            checkpoint_file = argv[++k];
+        else if (arg == "--resume" && k + 1 < argc)
+            resume_file = argv[++k];
+        else if (arg == "--spp" && k + 1 < argc)
+            samples_per_pixel = std::stoi(argv[++k]);
+        else if (arg == "--budget" && k + 1 < argc)
+            time_budget = std::stod(argv[++k]);
+        else if (arg == "--adaptive")
+            adaptive = true;
+        else if (arg == "--wavefront")
+            wavefront = true;
+        else if (arg == "--packets")
+            packets = true;
+        else if (arg == "--reorder")
+            reorder = true;
+        else if (arg == "--preview")
+            preview = true;
+        else if (arg == "--coarse-to-fine")
+            coarse_to_fine = true;
+        else if (arg == "--crop" && k + 1 < argc) {
+            pixel_region region;
+            if (std::sscanf(argv[++k], "%d,%d,%d,%d", &region.x0, &region.y0, &region.x1, &region.y1) == 4)
+                regions.push_back(region);
+        } else if (arg == "--strip" && k + 1 < argc)
+            std::sscanf(argv[++k], "%d/%d", &strip_index, &strip_count);
+        else if (arg == "--composite" && k + 1 < argc)
+            composite_file = argv[++k];
+        else if (arg == "--view")
+            interactive = true;
+        else if (arg == "--no-reprojection")
+            reprojection = false;
+        else if (arg == "--sequence" && k + 1 < argc)
+            sequence_file = argv[++k];
+        else if (arg == "--frames" && k + 1 < argc)
+            frame_count = std::stoi(argv[++k]);
+        else if (arg == "--frame-pattern" && k + 1 < argc)
+            frame_pattern = argv[++k];
+        else if (arg == "--output" && k + 1 < argc)
+            output_file = argv[++k];
+        else if (arg == "--exposure" && k + 1 < argc)
+            tone.exposure = std::stof(argv[++k]);
+        else if (arg == "--tonemap" && k + 1 < argc) {
+            std::string curve = argv[++k];
+            if (curve == "clamp")
+                tone.curve = tone_curve::clamp;
+            else if (curve == "reinhard")
+                tone.curve = tone_curve::reinhard;
+            else if (curve == "aces")
+                tone.curve = tone_curve::aces;
+            else {
+                std::cerr << "Unknown tone curve " << curve << " (clamp, reinhard or aces)\n";
+                return 1;
+            }
+        } else if (arg == "--srgb")
+            tone.transfer = transfer_curve::srgb;
+        else if (arg == "--grade" && k + 1 < argc)
+            grade_file = argv[++k];
+        else if (arg == "--shm" && k + 1 < argc)
+            shared_memory_name = argv[++k];
+        else if (arg == "--snapshot" && k + 1 < argc)
+            snapshot_name = argv[++k];
+        else if (arg == "--sampler" && k + 1 < argc)
+            sampler_name = argv[++k];
+        else if (arg == "--filter" && k + 1 < argc) {
+            std::string kind = argv[++k];
+            if (kind == "box")
+                filter = pixel_filter(filter_kind::box);
+            else if (kind == "gaussian")
+                filter = pixel_filter(filter_kind::gaussian);
+            else if (kind == "mitchell")
+                filter = pixel_filter(filter_kind::mitchell);
+            else if (kind == "blackman-harris")
+                filter = pixel_filter(filter_kind::blackman_harris);
+            else {
+                std::cerr << "Unknown filter " << kind << " (box, gaussian, mitchell or blackman-harris)\n";
+                return 1;
+            }
+        } else if (arg == "--denoise")
+            apply_denoiser = true;
+        else if (arg == "--aovs")
+            write_aovs = true;
+        else if (arg == "--heatmap")
+            write_heatmap = true;
+        else if (arg == "--stream")
+            streamed = true;
+        else if (arg == "--width" && k + 1 < argc)
+            image_width = std::stoi(argv[++k]);
+        else if (arg == "--stereo")
+            stereo = true;
+        else if (arg == "--turntable" && k + 1 < argc)
+            turntable_views = std::stoi(argv[++k]);
+    }
+
+    if (!grade_file.empty()) {
+        // Re-grade a float render with new tone settings instead of rendering.
+        framebuffer image;
+        if (!read_pfm(grade_file, image))
+            return 1;
+        auto start = std::chrono::steady_clock::now();
+        if (apply_denoiser) {
+            // Guided by the AOVs written next to the render with --aovs.
+            auto stem = path_stem(grade_file);
+            framebuffer albedo, normal, depth;
+            if (!read_pfm(stem + "_albedo.pfm", albedo) || !read_pfm(stem + "_normal.pfm", normal)
+                || !read_pfm(stem + "_depth.pfm", depth))
+                return 1;
+            image = denoise(image, albedo, normal, depth);
+        }
+        write_image(output_file, image, tone);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::clog << "Graded " << grade_file << " into " << output_file << " in " << elapsed.count() << " ms\n";
+        return 0;
+    }
+
+    if (!snapshot_name.empty()) {
+        // Save the current state of a render published with --shm by another process.
+        framebuffer image;
+        uint32_t samples;
+        uint64_t generation;
+        if (!map_shared_frame(snapshot_name, image, samples, generation))
+            return 1;
+        write_image(output_file, image, tone);
+        std::clog << "Snapshot of " << snapshot_name << " at generation " << generation << ", "
+                  << samples << " samples per pixel\n";
+        return 0;
+    }
 
     hittable_list world;
 
@@ -16,7 +184,8 @@ int main() {
     world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
 
     auto sun = make_shared<diffuse_light>(color(15, 15, 15));
-    world.add(make_shared<sphere>(point3(-4, 1, 3), 1.5, sun));
+    auto sun_sphere = make_shared<sphere>(point3(-4, 1, 3), 1.5, sun);
+    world.add(sun_sphere);
 
     // Materials
     auto left_red = make_shared<lambertian>(color(1.0, 0.2, 0.2));
@@ -32,20 +201,14 @@ int main() {
     auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
     world.add(make_shared<sphere>(point3(4, 1, 1), 0.5, material3));
 
-    // Add lights and check shadows
-    // Add phong as a lightning component -> Create light sources
-    // Bounding boxes
-    // Move Camera / Translate the objects
-    // Make it realtime??
-    // Clean code up
-
     camera cam;
 
     cam.aspect_ratio = 16.0 / 9.0;
-    cam.image_width = 800;
-    cam.samples_per_pixel = 500;
+    cam.image_width = image_width;
+    cam.samples_per_pixel = samples_per_pixel;
     cam.max_depth = 50;
     cam.background = color(0, 0, 0);
+    cam.lights.add(sun_sphere);
 
     cam.vfov = 20;
     cam.lookfrom = point3(13, 2, 3);
@@ -55,6 +218,111 @@ int main() {
     cam.defocus_angle = 0;
     cam.focus_dist = 10.0;
 
-    cam.render(world);
+    if (sampler_name == "independent")
+        cam.pixel_sampler = make_shared<independent_sampler>();
+    else if (sampler_name == "stratified")
+        cam.pixel_sampler = make_shared<stratified_sampler>(cam.samples_per_pixel);
+    else if (sampler_name == "sobol")
+        cam.pixel_sampler = make_shared<sobol_sampler>();
+    else if (sampler_name == "blue-noise")
+        cam.pixel_sampler = make_shared<blue_noise_sampler>();
+    else {
+        std::cerr << "Unknown sampler " << sampler_name << " (independent, stratified, sobol or blue-noise)\n";
+        return 1;
+    }
+
+    cam.output_file = output_file;
+    cam.tone = tone;
+    cam.shared_memory_name = shared_memory_name;
+    cam.write_aovs = write_aovs;
+    cam.apply_denoiser = apply_denoiser;
+    cam.write_heatmap = write_heatmap;
+    cam.filter = filter;
+
+    // Checkpointing and resuming imply a progressive render.
+    cam.checkpoint_file = checkpoint_file;
+    cam.resume_file = resume_file;
+    cam.coarse_to_fine = coarse_to_fine;
+    cam.regions = regions;
+    cam.composite_file = composite_file;
+    if (strip_count > 0)
+        cam.add_strip(strip_index, strip_count);
+    progressive = progressive || coarse_to_fine || !checkpoint_file.empty() || !resume_file.empty();
+
+    cam.time_budget = time_budget;
+    cam.adaptive_sampling = adaptive;
+    cam.reorder_rays = reorder;
+
+#if RAYTRACER_STATS
+    auto render_start = std::chrono::steady_clock::now();
+#endif
+
+    if (!sequence_file.empty()) {
+        camera_path path;
+        if (!path.load(sequence_file))
+            return 1;
+        if (!cam.render_sequence(world, path, frame_count > 0 ? frame_count : static_cast<int>(path.keys.size()),
+                                 frame_pattern))
+            return 1;
+    } else if (stereo || turntable_views > 0) {
+        // Stereo pair: both eyes look at lookat from 0.3 units apart. Turntable: views
+        // evenly spaced on the circle around the vertical axis through lookat.
+        // Each view is written next to the output file, e.g. image_left.ppm or image_3.ppm.
+        std::vector<camera> views;
+        std::vector<std::string> files;
+        auto stem = path_stem(output_file);
+        auto extension = output_file.substr(stem.size());
+        auto offset = cam.lookfrom - cam.lookat;
+        if (stereo) {
+            auto side = 0.15 * unit_vector(cross(offset, cam.vup));
+            views.assign(2, cam);
+            views[0].lookfrom = cam.lookfrom - side;
+            views[1].lookfrom = cam.lookfrom + side;
+            if (!shared_memory_name.empty()) {
+                views[0].shared_memory_name = shared_memory_name + "_left";
+                views[1].shared_memory_name = shared_memory_name + "_right";
+            }
+            files = {stem + "_left" + extension, stem + "_right" + extension};
+        } else {
+            for (int k = 0; k < turntable_views; ++k) {
+                auto angle = 2 * pi * k / turntable_views;
+                views.push_back(cam);
+                views.back().lookfrom = cam.lookat + vec3(offset.x() * cos(angle) - offset.z() * sin(angle), offset.y(),
+                                                          offset.x() * sin(angle) + offset.z() * cos(angle));
+                if (!shared_memory_name.empty())
+                    views.back().shared_memory_name = shared_memory_name + '_' + std::to_string(k);
+                files.push_back(stem + '_' + std::to_string(k) + extension);
+            }
+        }
+        std::vector<camera *> view_pointers;
+        for (auto &view: views)
+            view_pointers.push_back(&view);
+        camera::render_views(world, view_pointers, files);
+    } else if (interactive) {
+        viewer window(cam, world);
+        window.temporal_reprojection = reprojection;
+        window.run();
+    } else if (!cam.regions.empty()) {
+        if (!cam.render_regions(world))
+            return 1;
+    } else if (preview)
+        cam.render_preview(world);
+    else if (time_budget > 0)
+        cam.render_budgeted(world);
+    else if (progressive) {
+        if (!cam.render_progressive(world))
+            return 1;
+    } else if (wavefront)
+        cam.render_wavefront(world);
+    else if (packets)
+        cam.render_packets(world);
+    else if (streamed)
+        cam.render_streamed(world);
+    else
+        cam.render(world);
 
+#if RAYTRACER_STATS
+    std::chrono::duration<double> render_seconds = std::chrono::steady_clock::now() - render_start;
+    print_render_stats(std::clog, render_seconds.count());
+#endif
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define RAYTRACER_MATERIAL_H
 
 #include "rtweekend.h"
+#include "sampler.h"
 #include "texture.h"
 
 class hit_record;
@@ -16,64 +17,74 @@ public:
 
     virtual bool scatter(
             const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const = 0;
+
+    // Diffuse reflectance at the hit point, for preview shading.
+    virtual color albedo_at(const hit_record &rec) const {
+        return color(0, 0, 0);
+    }
+
+    // True for mirror-like materials, which a Whitted-style preview follows by
+    // scattering instead of shading them with the lights.
+    virtual bool is_specular() const {
+        return false;
+    }
+
+    // Light reflected towards view_direction from a light of the given strength in
+    // light_direction (both unit vectors pointing away from the surface).
+    virtual color shade_direct(const hit_record &rec, const vec3 &light_direction, const vec3 &view_direction,
+                               const color &light) const {
+        return albedo_at(rec) * light * fmax(0.0, dot(rec.normal, light_direction));
+    }
 };
 
 class phong : public material {
 public:
-    phong(const color &a, const vec3 _camera_pos, const color _light_color, const vec3 _light_pos)
-            : albedo(make_shared<solid_color>(a)),
-              camera_pos(_camera_pos),
-              light_color(_light_color),
-              light_pos(_light_pos) {}
+    phong(const color &a, double _shininess = 32) : albedo(make_shared<solid_color>(a)), shininess(_shininess) {}
 
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered)
     const override {
-        vec3 diffuse_color = diffuse(rec);
-        vec3 ambient_color = ambient(0.1, rec);
-        vec3 specular_color = specular(0.5, rec);
-
-        auto phong_color = ambient_color + diffuse_color + specular_color;
-
-        auto scatter_direction = rec.normal + random_unit_vector();
-
-        // Catch degenerate scatter direction
-        if (scatter_direction.near_zero())
-            scatter_direction = rec.normal;
+        // Path traced like a lambertian surface; the phong terms are used by direct lighting.
+        onb uvw(rec.normal);
+        auto scatter_direction = uvw.local(sampled_cosine_direction());
 
         scattered = ray(rec.p, scatter_direction);
         attenuation = albedo->value(rec.u, rec.v, rec.p);
         return true;
     }
 
-    vec3 diffuse(const hit_record &rec) const {
-        auto light_direction = unit_vector(light_pos - rec.p);
-        auto illumination = light_color * (dot(rec.normal, light_direction));
-        auto reflected_light = rec.p * illumination; // Might be dot product not sure
-        // Also might be the formula with max value so it does not hit below 0
-        return (1 / pi) * reflected_light;
+    color albedo_at(const hit_record &rec) const override {
+        return albedo->value(rec.u, rec.v, rec.p);
     }
 
-    vec3 specular(const double shinyness, const hit_record &rec) const {
-        auto view_direction = unit_vector(camera_pos - rec.p);
-        auto light_direction = unit_vector(light_pos - rec.p);
-        auto illumination = light_color * (dot(rec.normal, light_direction));
-        color white = color(255, 255, 255);
-        auto reflected_light = white * illumination;
-        auto reflection_vector = 2 * (light_direction * rec.normal) * rec.normal - light_direction;
-        return reflected_light * pow(dot(reflection_vector, view_direction), shinyness);
+    color shade_direct(const hit_record &rec, const vec3 &light_direction, const vec3 &view_direction,
+                       const color &light) const override {
+        return ambient(0.1, rec, light)
+               + diffuse(rec, light_direction, light)
+               + specular(0.5, rec, light_direction, view_direction, light);
     }
 
-    vec3 ambient(const double ambient_strength, const hit_record &rec) const {
+    vec3 diffuse(const hit_record &rec, const vec3 &light_direction, const color &light) const {
         auto object_color = albedo->value(rec.u, rec.v, rec.p);
-        auto ambient = ambient_strength * light_color;
-        return ambient * object_color;
+        return object_color * light * fmax(0.0, dot(rec.normal, light_direction));
+    }
+
+    vec3 specular(const double strength, const hit_record &rec, const vec3 &light_direction,
+                  const vec3 &view_direction, const color &light) const {
+        auto n_dot_l = dot(rec.normal, light_direction);
+        if (n_dot_l <= 0)
+            return color(0, 0, 0);
+        auto reflection_vector = 2 * n_dot_l * rec.normal - light_direction;
+        return strength * light * pow(fmax(0.0, dot(reflection_vector, view_direction)), shininess);
+    }
+
+    vec3 ambient(const double ambient_strength, const hit_record &rec, const color &light) const {
+        auto object_color = albedo->value(rec.u, rec.v, rec.p);
+        return ambient_strength * light * object_color;
     }
 
 private:
     shared_ptr<texture> albedo;
-    vec3 camera_pos;
-    color light_color;
-    vec3 light_pos;
+    double shininess;
 };
 
 class lambertian : public material {
@@ -84,17 +95,19 @@ public:
 
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered)
     const override {
-        auto scatter_direction = rec.normal + random_unit_vector();
-
-        // Catch degenerate scatter direction
-        if (scatter_direction.near_zero())
-            scatter_direction = rec.normal;
+        // Cosine-weighted around the normal, never degenerate.
+        onb uvw(rec.normal);
+        auto scatter_direction = uvw.local(sampled_cosine_direction());
 
         scattered = ray(rec.p, scatter_direction);
         attenuation = albedo->value(rec.u, rec.v, rec.p);
         return true;
     }
 
+    color albedo_at(const hit_record &rec) const override {
+        return albedo->value(rec.u, rec.v, rec.p);
+    }
+
 private:
     shared_ptr<texture> albedo;
 };
@@ -106,11 +119,19 @@ public:
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered)
     const override {
         vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-        scattered = ray(rec.p, reflected + fuzz * random_unit_vector());
+        scattered = ray(rec.p, reflected + fuzz * sampled_unit_vector());
         attenuation = albedo;
         return (dot(scattered.direction(), rec.normal) > 0);
     }
 
+    color albedo_at(const hit_record &rec) const override {
+        return albedo;
+    }
+
+    bool is_specular() const override {
+        return true;
+    }
+
 private:
     color albedo;
     double fuzz;
@@ -132,7 +153,7 @@ public:
         bool cannot_refract = refraction_ratio * sin_theta > 1.0;
         vec3 direction;
 
-        if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+        if (cannot_refract || reflectance(cos_theta, refraction_ratio) > sample_1d())
             direction = reflect(unit_direction, rec.normal);
         else
             direction = refract(unit_direction, rec.normal, refraction_ratio);
@@ -141,6 +162,14 @@ public:
         return true;
     }
 
+    color albedo_at(const hit_record &rec) const override {
+        return color(1.0, 1.0, 1.0);
+    }
+
+    bool is_specular() const override {
+        return true;
+    }
+
 private:
     double ir; // Index of Refraction
 
@@ -6,6 +6,7 @@
 
 #include "rtweekend.h"
 #include "hittable.h"
+#include "stats.h"
 
 #include <cmath>
 
@@ -17,9 +18,15 @@ public:
         normal = unit_vector(n);
         D = dot(normal, Q);
         w = n / dot(n, n);
+
+        // The plane is not axis aligned in general, so bound all four corners.
+        bbox = aabb(aabb(Q, Q + u + v), aabb(Q + u, Q + v)).pad();
     }
 
+    aabb bounding_box() const override { return bbox; }
+
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+        RT_COUNT(quad_tests);
         auto denom = dot(normal, r.direction());
 
         // No hit if the ray is parallel to the plane
@@ -41,11 +48,50 @@ public:
         rec.t = t;
         rec.p = intersection;
         rec.mat = mat;
+        rec.object = this;
         rec.set_face_normal(r, normal);
 
         return true;
     }
 
+    void hit_packet(const ray_packet &rays, double t_min, packet_hit &hits) const override {
+        double t[packet_width], alpha[packet_width], beta[packet_width];
+        int64_t candidate[packet_width];
+        RT_COUNT_N(quad_tests, std::count(rays.active, rays.active + packet_width, 1));
+
+        // Plane intersection and plane coordinates for all lanes in one vector loop.
+#pragma omp simd
+        for (int k = 0; k < packet_width; ++k) {
+            auto denom = normal.x() * rays.direction_x[k] + normal.y() * rays.direction_y[k]
+                         + normal.z() * rays.direction_z[k];
+            auto safe_denom = fabs(denom) < 1e-8 ? 1.0 : denom;
+            t[k] = (D - (normal.x() * rays.origin_x[k] + normal.y() * rays.origin_y[k]
+                         + normal.z() * rays.origin_z[k])) / safe_denom;
+
+            auto px = rays.origin_x[k] + t[k] * rays.direction_x[k] - Q.x();
+            auto py = rays.origin_y[k] + t[k] * rays.direction_y[k] - Q.y();
+            auto pz = rays.origin_z[k] + t[k] * rays.direction_z[k] - Q.z();
+
+            // alpha = w . (p x v), beta = w . (u x p)
+            alpha[k] = w.x() * (py * v.z() - pz * v.y()) + w.y() * (pz * v.x() - px * v.z())
+                       + w.z() * (px * v.y() - py * v.x());
+            beta[k] = w.x() * (u.y() * pz - u.z() * py) + w.y() * (u.z() * px - u.x() * pz)
+                      + w.z() * (u.x() * py - u.y() * px);
+
+            // Masks joined with &, not &&, so the loop has no branches and vectorizes.
+            candidate[k] = rays.active[k] & (fabs(denom) >= 1e-8) & (t_min <= t[k]) & (t[k] <= hits.t[k]);
+        }
+
+        // The shape test is virtual (quad or triangle), so it runs per lane.
+        hit_record unused;
+        for (int k = 0; k < packet_width; ++k) {
+            if (candidate[k] && is_interior(alpha[k], beta[k], unused)) {
+                hits.t[k] = t[k];
+                hits.object[k] = this;
+            }
+        }
+    }
+
     virtual bool is_interior(double a, double b, hit_record &rec) const {
         // Given the hit point in plane coordinates, return false if it is outside the
         // primitive, otherwise set the hit record UV coordinates and return true.
@@ -63,6 +109,7 @@ private:
     vec3 normal;
     double D;
     vec3 w;
+    aabb bbox;
 };
 
 
@@ -0,0 +1,76 @@
+#ifndef RAYTRACER_RAY_PACKET_H
+#define RAYTRACER_RAY_PACKET_H
+
+#include "ray.h"
+
+#include <cstdint>
+#include <limits>
+
+// Lanes per packet; build with -DRAYTRACER_PACKET_WIDTH=4 or 16 to match the SIMD
+// width of the target (4 doubles fill an AVX register, 8 an AVX-512 one).
+#ifndef RAYTRACER_PACKET_WIDTH
+#define RAYTRACER_PACKET_WIDTH 8
+#endif
+
+constexpr int packet_width = RAYTRACER_PACKET_WIDTH;
+static_assert(packet_width == 4 || packet_width == 8 || packet_width == 16,
+              "packet width must be 4, 8 or 16");
+
+class hittable;
+
+// A bundle of rays in structure-of-arrays layout, so a primitive test can run over
+// all lanes in one vectorized loop. Inactive lanes are carried along but ignored.
+struct ray_packet {
+    double origin_x[packet_width];
+    double origin_y[packet_width];
+    double origin_z[packet_width];
+    double direction_x[packet_width];
+    double direction_y[packet_width];
+    double direction_z[packet_width];
+    double inv_direction_x[packet_width];
+    double inv_direction_y[packet_width];
+    double inv_direction_z[packet_width];
+    int64_t active[packet_width]; // 1 for live lanes, 0 otherwise; as wide as a double so masks vectorize
+
+    void set(int k, const ray &r) {
+        auto o = r.origin();
+        auto d = r.direction();
+        origin_x[k] = o.x();
+        origin_y[k] = o.y();
+        origin_z[k] = o.z();
+        direction_x[k] = d.x();
+        direction_y[k] = d.y();
+        direction_z[k] = d.z();
+        inv_direction_x[k] = 1 / d.x();
+        inv_direction_y[k] = 1 / d.y();
+        inv_direction_z[k] = 1 / d.z();
+        active[k] = 1;
+    }
+
+    void deactivate(int k) {
+        // Keeps the lane's numbers finite so vector loops over it stay harmless.
+        set(k, ray(point3(0, 0, 0), vec3(1, 1, 1)));
+        active[k] = 0;
+    }
+
+    ray lane(int k) const {
+        return ray(point3(origin_x[k], origin_y[k], origin_z[k]),
+                   vec3(direction_x[k], direction_y[k], direction_z[k]));
+    }
+};
+
+// Closest hit found so far for every lane: its ray parameter and the primitive that
+// produced it. The full hit_record is only built once traversal has finished.
+struct packet_hit {
+    double t[packet_width];
+    const hittable *object[packet_width];
+
+    void reset() {
+        for (int k = 0; k < packet_width; ++k) {
+            t[k] = std::numeric_limits<double>::infinity();
+            object[k] = nullptr;
+        }
+    }
+};
+
+#endif //RAYTRACER_RAY_PACKET_H
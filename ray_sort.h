@@ -0,0 +1,93 @@
+#ifndef RAYTRACER_RAY_SORT_H
+#define RAYTRACER_RAY_SORT_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+
+#include <cstdint>
+#include <vector>
+
+// Reordering of incoherent (secondary) rays so that rays traced one after the other
+// start close together and point the same way, and therefore visit the same boxes
+// and primitives while they are still in cache. The key puts the direction octant
+// in the top 3 bits and a 30-bit Morton code of the origin, quantized to a 1024^3
+// grid over the bounds of all origins, below it.
+
+inline uint32_t expand_bits_10(uint32_t v) {
+    // Spreads the low 10 bits of v so two zero bits separate each of them.
+    v &= 0x3ffU;
+    v = (v | (v << 16)) & 0x030000ffU;
+    v = (v | (v << 8)) & 0x0300f00fU;
+    v = (v | (v << 4)) & 0x030c30c3U;
+    v = (v | (v << 2)) & 0x09249249U;
+    return v;
+}
+
+inline uint64_t ray_sort_key(const ray &r, const aabb &origin_bounds) {
+    auto d = r.direction();
+    uint64_t octant = (d.x() < 0 ? 4 : 0) | (d.y() < 0 ? 2 : 0) | (d.z() < 0 ? 1 : 0);
+
+    auto o = r.origin();
+    auto cell = [](double value, const interval &range) {
+        auto extent = range.size() > 0 ? range.size() : 1.0;
+        auto scaled = (value - range.min) / extent * 1023.0;
+        return static_cast<uint32_t>(scaled < 0 ? 0 : (scaled > 1023 ? 1023 : scaled));
+    };
+    uint64_t morton = (expand_bits_10(cell(o.x(), origin_bounds.x)) << 2)
+                      | (expand_bits_10(cell(o.y(), origin_bounds.y)) << 1)
+                      | expand_bits_10(cell(o.z(), origin_bounds.z));
+
+    return (octant << 30) | morton;
+}
+
+// Stable LSD radix sort of the items by their 33-bit keys, three 11-bit digits.
+// Much cheaper than a comparison sort for the batch sizes of a wavefront.
+inline void radix_sort_by_key(std::vector<int> &items, std::vector<uint64_t> &keys) {
+    const int digit_bits = 11;
+    const uint64_t digit_mask = (1U << digit_bits) - 1;
+
+    std::vector<int> items_out(items.size());
+    std::vector<uint64_t> keys_out(keys.size());
+    std::vector<size_t> offsets(size_t(1) << digit_bits);
+
+    for (int shift = 0; shift < 33; shift += digit_bits) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (auto key: keys)
+            ++offsets[(key >> shift) & digit_mask];
+
+        size_t total = 0;
+        for (auto &offset: offsets) {
+            auto count = offset;
+            offset = total;
+            total += count;
+        }
+
+        for (size_t k = 0; k < items.size(); ++k) {
+            auto slot = offsets[(keys[k] >> shift) & digit_mask]++;
+            items_out[slot] = items[k];
+            keys_out[slot] = keys[k];
+        }
+        items.swap(items_out);
+        keys.swap(keys_out);
+    }
+}
+
+// How coherent the intersection stream was. Hardware cache misses cannot be counted
+// portably, so the proxy is how often consecutive rays first hit a different
+// primitive: every switch means touching other primitive and material data.
+struct ray_order_stats {
+    long long rays = 0;
+    long long primitive_switches = 0;
+    double intersect_seconds = 0;
+
+    double switch_rate() const {
+        return rays == 0 ? 0.0 : static_cast<double>(primitive_switches) / rays;
+    }
+
+    double rays_per_second() const {
+        return intersect_seconds == 0 ? 0.0 : rays / intersect_seconds;
+    }
+};
+
+#endif //RAYTRACER_RAY_SORT_H
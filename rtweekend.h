@@ -20,8 +20,9 @@ inline double degrees_to_radians(double degrees) {
 }
 
 inline double random_double() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
+    // One generator per thread, so render workers never share its state.
+    thread_local std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    thread_local std::mt19937 generator;
     return distribution(generator);
 }
 
@@ -32,5 +33,6 @@ inline double random_double(double min, double max) {
 #include "interval.h"
 #include "ray.h"
 #include "vec3.h"
+#include "sampling.h"
 
 #endif //RAYTRACER_RTWEEKEND_H
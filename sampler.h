@@ -0,0 +1,331 @@
+#ifndef RAYTRACER_SAMPLER_H
+#define RAYTRACER_SAMPLER_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+// Samplers hand out the random numbers of one pixel sample dimension by dimension:
+// dimensions 0-1 pick the point in the pixel, 2-3 the point on the lens and every
+// bounce after that consumes the next dimensions. Each sampler is a pure function
+// of (pixel, sample index, dimension, seed), so renders are reproducible.
+
+inline uint32_t hash_uint32(uint32_t x) {
+    // Integer finalizer with good avalanche behaviour (from "hash prospector").
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t hash_combine(uint32_t seed, uint32_t v) {
+    return seed ^ (hash_uint32(v) + 0x9e3779b9U + (seed << 6) + (seed >> 2));
+}
+
+inline double uint32_to_unit(uint32_t x) {
+    // Maps the 32 bits to [0,1) without ever returning exactly 1.
+    return x * (1.0 / 4294967296.0);
+}
+
+class sampler {
+public:
+    virtual ~sampler() = default;
+
+    // Prepares the sampler for sample `index` of pixel (i, j); dimensions restart at 0.
+    virtual void start_pixel_sample(int i, int j, int index) {
+        px = i;
+        py = j;
+        sample_index = index;
+        dimension = 0;
+    }
+
+    // Continues a pixel sample whose path was suspended after `dim` dimensions,
+    // e.g. when paths are traced in batches rather than one after the other.
+    void resume_pixel_sample(int i, int j, int index, int dim) {
+        start_pixel_sample(i, j, index);
+        dimension = dim;
+    }
+
+    int current_dimension() const { return dimension; }
+
+    virtual double get_1d() = 0;
+
+    virtual void get_2d(double &u, double &v) = 0;
+
+    // Every render thread works on its own copy.
+    virtual shared_ptr<sampler> clone() const = 0;
+
+    // Identifies the sequence, e.g. to check a checkpoint is resumed with the same one.
+    virtual std::string name() const = 0;
+
+    // Setting of the sequence besides the seed that a resumed render must keep, such as
+    // the number of strata; 0 for samplers that have none.
+    virtual uint32_t parameter() const { return 0; }
+
+    virtual void set_parameter(uint32_t) {}
+
+    uint32_t seed = 0;
+
+protected:
+    int px = 0;
+    int py = 0;
+    int sample_index = 0;
+    int dimension = 0;
+
+    uint32_t dimension_hash(int dim) const {
+        auto h = hash_combine(seed, static_cast<uint32_t>(px));
+        h = hash_combine(h, static_cast<uint32_t>(py));
+        return hash_combine(h, static_cast<uint32_t>(dim));
+    }
+};
+
+// Plain Monte Carlo: every dimension is an independent uniform number.
+class independent_sampler : public sampler {
+public:
+    double get_1d() override {
+        return uint32_to_unit(next());
+    }
+
+    void get_2d(double &u, double &v) override {
+        u = uint32_to_unit(next());
+        v = uint32_to_unit(next());
+    }
+
+    shared_ptr<sampler> clone() const override {
+        return make_shared<independent_sampler>(*this);
+    }
+
+    std::string name() const override {
+        return "independent";
+    }
+
+private:
+    uint32_t next() {
+        return hash_combine(dimension_hash(dimension++), static_cast<uint32_t>(sample_index));
+    }
+};
+
+// Jittered stratification: the samples of a pixel are spread over an n x n grid
+// (n strata for 1D), visited in a different random order for every dimension.
+class stratified_sampler : public sampler {
+public:
+    stratified_sampler(int samples_per_pixel) {
+        set_parameter(samples_per_pixel < 1 ? 1 : samples_per_pixel);
+    }
+
+    double get_1d() override {
+        auto h = dimension_hash(dimension++);
+        auto stratum = permute(sample_index % strata_1d, strata_1d, hash_combine(h, sample_index / strata_1d));
+        auto jitter = uint32_to_unit(hash_combine(h, ~static_cast<uint32_t>(sample_index)));
+        return (stratum + jitter) / strata_1d;
+    }
+
+    void get_2d(double &u, double &v) override {
+        auto h = dimension_hash(dimension);
+        dimension += 2;
+        auto cells = strata_2d * strata_2d;
+        auto stratum = permute(sample_index % cells, cells, hash_combine(h, sample_index / cells));
+        u = (stratum % strata_2d + uint32_to_unit(hash_combine(h, 2 * sample_index + 1))) / strata_2d;
+        v = (stratum / strata_2d + uint32_to_unit(hash_combine(h, 2 * sample_index + 2))) / strata_2d;
+    }
+
+    shared_ptr<sampler> clone() const override {
+        return make_shared<stratified_sampler>(*this);
+    }
+
+    std::string name() const override {
+        return "stratified";
+    }
+
+    uint32_t parameter() const override {
+        return static_cast<uint32_t>(strata_1d);
+    }
+
+    void set_parameter(uint32_t samples_per_pixel) override {
+        // A resumed render keeps the strata it was started with, even when it is now
+        // asked for more samples per pixel.
+        strata_1d = static_cast<int>(std::clamp<uint32_t>(samples_per_pixel, 1, 1 << 24)); // n x n cells fit an int
+        strata_2d = static_cast<int>(ceil(sqrt(static_cast<double>(strata_1d))));
+    }
+
+private:
+    int strata_1d;
+    int strata_2d;
+
+    static int permute(uint32_t i, uint32_t n, uint32_t p) {
+        // Random permutation of [0, n) evaluated one element at a time
+        // (Kensler, "Correlated Multi-Jittered Sampling").
+        uint32_t w = n - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do {
+            i ^= p;
+            i *= 0xe170893dU;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8;
+            i *= 0x0929eb3fU;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1 | p >> 27;
+            i *= 0x6935fa69U;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303U;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3U;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3dfU;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= n);
+        return static_cast<int>((i + p) % n);
+    }
+};
+
+// Owen-scrambled Sobol points, padded: every pair of dimensions is an independently
+// shuffled and scrambled copy of the first two Sobol dimensions
+// (Burley, "Practical Hash-based Owen Scrambling").
+class sobol_sampler : public sampler {
+public:
+    double get_1d() override {
+        auto h = dimension_hash(dimension++);
+        auto index = nested_uniform_scramble(static_cast<uint32_t>(sample_index), h);
+        return uint32_to_unit(nested_uniform_scramble(reverse_bits(index), hash_combine(h, 1)));
+    }
+
+    void get_2d(double &u, double &v) override {
+        auto h = dimension_hash(dimension);
+        dimension += 2;
+        auto index = nested_uniform_scramble(static_cast<uint32_t>(sample_index), h);
+        u = uint32_to_unit(nested_uniform_scramble(reverse_bits(index), hash_combine(h, 1)));
+        v = uint32_to_unit(nested_uniform_scramble(sobol_second_dimension(index), hash_combine(h, 2)));
+    }
+
+    shared_ptr<sampler> clone() const override {
+        return make_shared<sobol_sampler>(*this);
+    }
+
+    std::string name() const override {
+        return "sobol";
+    }
+
+private:
+    static uint32_t reverse_bits(uint32_t x) {
+        x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+        x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fU) | ((x & 0x0f0f0f0fU) << 4);
+        x = ((x >> 8) & 0x00ff00ffU) | ((x & 0x00ff00ffU) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    static uint32_t sobol_second_dimension(uint32_t index) {
+        uint32_t result = 0;
+        for (uint32_t v = 1U << 31; index; index >>= 1, v ^= v >> 1)
+            if (index & 1)
+                result ^= v;
+        return result;
+    }
+
+    static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+        x += seed;
+        x ^= x * 0x6c50b47cU;
+        x ^= x * 0xb82f1e52U;
+        x ^= x * 0xc7afe638U;
+        x ^= x * 0x8d22f6e6U;
+        return x;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+};
+
+// Rank-1 lattice (the R2 sequence) rotated per pixel by interleaved gradient noise,
+// which distributes the error over the image as blue noise instead of white noise.
+class blue_noise_sampler : public sampler {
+public:
+    double get_1d() override {
+        auto dim = dimension++;
+        auto shift = pixel_noise(dim);
+        return fract(0.5 + sample_index * 0.6180339887498949 + shift);
+    }
+
+    void get_2d(double &u, double &v) override {
+        auto dim = dimension;
+        dimension += 2;
+        u = fract(0.5 + sample_index * 0.7548776662466927 + pixel_noise(dim));
+        v = fract(0.5 + sample_index * 0.5698402909980532 + pixel_noise(dim + 1));
+    }
+
+    shared_ptr<sampler> clone() const override {
+        return make_shared<blue_noise_sampler>(*this);
+    }
+
+    std::string name() const override {
+        return "blue-noise";
+    }
+
+private:
+    static double fract(double x) {
+        return x - floor(x);
+    }
+
+    double pixel_noise(int dim) const {
+        // Each dimension looks up the noise at a differently offset pixel so
+        // dimensions stay uncorrelated.
+        auto h = hash_combine(seed, static_cast<uint32_t>(dim));
+        auto x = px + static_cast<double>(h & 0xffff);
+        auto y = py + static_cast<double>(h >> 16);
+        return fract(52.9829189 * fract(0.06711056 * x + 0.00583715 * y));
+    }
+};
+
+// The sampler of the pixel sample the current thread is tracing. Materials draw
+// their bounce dimensions from it; without one they fall back to random_double().
+inline sampler *&active_sampler() {
+    thread_local sampler *current = nullptr;
+    return current;
+}
+
+inline double sample_1d() {
+    auto s = active_sampler();
+    return s ? s->get_1d() : random_double();
+}
+
+inline void sample_2d(double &u, double &v) {
+    auto s = active_sampler();
+    if (s) {
+        s->get_2d(u, v);
+    } else {
+        u = random_double();
+        v = random_double();
+    }
+}
+
+inline vec3 sampled_unit_vector() {
+    double u1, u2;
+    sample_2d(u1, u2);
+    return square_to_unit_sphere(u1, u2);
+}
+
+inline vec3 sampled_cosine_direction() {
+    // Cosine-weighted direction around +z; take it to world space with an onb.
+    double u1, u2;
+    sample_2d(u1, u2);
+    return square_to_cosine_hemisphere(u1, u2);
+}
+
+inline vec3 sampled_in_unit_disk() {
+    double u1, u2;
+    sample_2d(u1, u2);
+    return square_to_unit_disk(u1, u2);
+}
+
+#endif //RAYTRACER_SAMPLER_H
@@ -0,0 +1,88 @@
+#ifndef RAYTRACER_SAMPLING_H
+#define RAYTRACER_SAMPLING_H
+
+#include "vec3.h"
+
+// Closed-form warps from the unit square to the shapes we sample. Unlike rejection
+// sampling they take a fixed number of uniforms and never loop, so they work with
+// low-discrepancy samplers and do not cause branch mispredictions.
+
+inline vec3 square_to_unit_disk(double u1, double u2) {
+    // Concentric mapping (Shirley & Chiu), written without branches on the sample.
+    auto a = 2 * u1 - 1;
+    auto b = 2 * u2 - 1;
+    auto use_a = fabs(a) > fabs(b);
+    auto r = use_a ? a : b;
+    auto ratio = use_a ? b / (a != 0 ? a : 1) : a / (b != 0 ? b : 1);
+    auto theta = use_a ? (pi / 4) * ratio : (pi / 2) - (pi / 4) * ratio;
+    return vec3(r * cos(theta), r * sin(theta), 0);
+}
+
+inline vec3 square_to_unit_sphere(double u1, double u2) {
+    // Uniform direction: z is uniform in [-1,1] by Archimedes' hat-box theorem.
+    auto z = 1 - 2 * u1;
+    auto r = sqrt(fmax(0.0, 1 - z * z));
+    auto phi = 2 * pi * u2;
+    return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+inline vec3 square_to_unit_ball(double u1, double u2, double u3) {
+    // Uniform point inside the sphere: uniform direction scaled by the cube root.
+    return cbrt(u3) * square_to_unit_sphere(u1, u2);
+}
+
+inline vec3 square_to_cosine_hemisphere(double u1, double u2) {
+    // Cosine-weighted direction around +z (Malley's method).
+    auto r = sqrt(u1);
+    auto phi = 2 * pi * u2;
+    return vec3(r * cos(phi), r * sin(phi), sqrt(fmax(0.0, 1 - u1)));
+}
+
+inline vec3 random_in_unit_disk() {
+    return square_to_unit_disk(random_double(), random_double());
+}
+
+inline vec3 random_in_unit_sphere() {
+    return square_to_unit_ball(random_double(), random_double(), random_double());
+}
+
+inline vec3 random_unit_vector() {
+    return square_to_unit_sphere(random_double(), random_double());
+}
+
+inline vec3 random_on_hemisphere(const vec3 &normal) {
+    vec3 on_unit_sphere = random_unit_vector();
+    if (dot(on_unit_sphere, normal) > 0.0) // In the same hemisphere as the normal
+        return on_unit_sphere;
+    else
+        return -on_unit_sphere;
+}
+
+// Orthonormal basis around a unit vector w, used to take local samples to world space.
+class onb {
+public:
+    onb(const vec3 &n) {
+        // Branchless construction (Duff et al., "Building an Orthonormal Basis, Revisited").
+        axis[2] = n;
+        auto sign = copysign(1.0, n.z());
+        auto a = -1.0 / (sign + n.z());
+        auto b = n.x() * n.y() * a;
+        axis[0] = vec3(1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+        axis[1] = vec3(b, sign + n.y() * n.y() * a, -n.y());
+    }
+
+    vec3 u() const { return axis[0]; }
+
+    vec3 v() const { return axis[1]; }
+
+    vec3 w() const { return axis[2]; }
+
+    vec3 local(const vec3 &a) const {
+        return a.x() * axis[0] + a.y() * axis[1] + a.z() * axis[2];
+    }
+
+private:
+    vec3 axis[3];
+};
+
+#endif //RAYTRACER_SAMPLING_H
@@ -0,0 +1,146 @@
+#ifndef RAYTRACER_SHARED_FRAMEBUFFER_H
+#define RAYTRACER_SHARED_FRAMEBUFFER_H
+
+#include "accumulation_buffer.h"
+#include "framebuffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+
+// Start of a shared-memory frame. The pixels follow directly after it as width *
+// height * 3 floats of linear RGB, rows top to bottom, not tone mapped.
+struct shared_frame_header {
+    char magic[8];                       // "RTFRAME\0"
+    uint32_t version;                    // 1
+    uint32_t width;
+    uint32_t height;
+    uint32_t header_size;                // Offset of the pixels in bytes
+    std::atomic<uint32_t> sample_count;  // Samples per pixel of the newest complete pass
+    std::atomic<uint64_t> generation;    // Bumped after every published tile
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "shared frame counters must be lock-free to work across processes");
+
+// Publishes the estimate of an accumulation buffer in a POSIX shared-memory object,
+// so other local processes can map it (see map_shared_frame) and watch the render
+// without touching files. Writers store pixels and the counters with relaxed and
+// release atomics and never lock; a reader that loads the generation with acquire
+// sees every tile published before it. A tile being written while it is read may
+// show a mix of old and new pixels. The object is removed when this goes away.
+class shared_framebuffer {
+public:
+    shared_framebuffer(const std::string &_name, int width, int height) : name(_name) {
+        size = sizeof(shared_frame_header) + static_cast<size_t>(width) * height * 3 * sizeof(float);
+
+        auto fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            std::cerr << "Cannot create shared memory " << name << '\n';
+            if (fd >= 0)
+                ::close(fd);
+            return;
+        }
+        auto memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+            std::cerr << "Cannot map shared memory " << name << '\n';
+            return;
+        }
+
+        header = new(memory) shared_frame_header{};
+        std::memcpy(header->magic, "RTFRAME", 8);
+        header->version = 1;
+        header->width = width;
+        header->height = height;
+        header->header_size = sizeof(shared_frame_header);
+        pixels = reinterpret_cast<float *>(static_cast<char *>(memory) + sizeof(shared_frame_header));
+    }
+
+    shared_framebuffer(const shared_framebuffer &) = delete;
+
+    shared_framebuffer &operator=(const shared_framebuffer &) = delete;
+
+    ~shared_framebuffer() {
+        if (!header)
+            return;
+        ::munmap(header, size);
+        ::shm_unlink(name.c_str());
+    }
+
+    bool good() const { return header != nullptr; }
+
+    template<typename Film>
+    void publish_tile(const Film &film, int x0, int y0, int x1, int y1) {
+        // Copies the estimate of the pixels [x0, x1) x [y0, y1) of a whole-image film
+        // (accumulation_buffer or splat_film) and bumps the generation.
+        for (int j = y0; j < y1; ++j) {
+            for (int i = x0; i < x1; ++i) {
+                auto c = film.estimate(i, j);
+                auto p = pixels + (static_cast<size_t>(j) * film.width + i) * 3;
+                std::atomic_ref<float>(p[0]).store(static_cast<float>(c.x()), std::memory_order_relaxed);
+                std::atomic_ref<float>(p[1]).store(static_cast<float>(c.y()), std::memory_order_relaxed);
+                std::atomic_ref<float>(p[2]).store(static_cast<float>(c.z()), std::memory_order_relaxed);
+            }
+        }
+        header->generation.fetch_add(1, std::memory_order_release);
+    }
+
+    void publish(const accumulation_buffer &film, int sample_count) {
+        // Whole film after a pass that brought every pixel to sample_count samples.
+        publish_tile(film, 0, 0, film.width, film.height);
+        set_sample_count(sample_count);
+    }
+
+    void set_sample_count(int sample_count) {
+        header->sample_count.store(sample_count, std::memory_order_release);
+    }
+
+private:
+    std::string name;
+    size_t size = 0;
+    shared_frame_header *header = nullptr;
+    float *pixels = nullptr;
+};
+
+inline bool map_shared_frame(const std::string &name, framebuffer &image, uint32_t &sample_count,
+                             uint64_t &generation) {
+    // Reader side: copies the current state of a published frame.
+    auto fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "No shared frame " << name << '\n';
+        return false;
+    }
+    struct stat info;
+    auto memory = ::fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(shared_frame_header)
+                  ? ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (memory == MAP_FAILED)
+        return false;
+
+    auto header = static_cast<shared_frame_header *>(memory);
+    auto expected = header->header_size + static_cast<size_t>(header->width) * header->height * 3 * sizeof(float);
+    auto valid = std::memcmp(header->magic, "RTFRAME", 8) == 0 && header->version == 1
+                 && static_cast<size_t>(info.st_size) >= expected;
+    if (valid) {
+        generation = header->generation.load(std::memory_order_acquire);
+        sample_count = header->sample_count.load(std::memory_order_acquire);
+        image = framebuffer(header->width, header->height);
+        auto pixels = reinterpret_cast<float *>(static_cast<char *>(memory) + header->header_size);
+        for (size_t k = 0; k < image.data.size(); ++k)
+            image.data[k] = std::atomic_ref<float>(pixels[k]).load(std::memory_order_relaxed);
+    }
+
+    ::munmap(memory, info.st_size);
+    return valid;
+}
+
+#endif //RAYTRACER_SHARED_FRAMEBUFFER_H
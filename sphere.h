@@ -2,14 +2,19 @@
 #define RAYTRACER_SPHERE_H
 
 #include "hittable.h"
+#include "stats.h"
 #include "vec3.h"
 
 class sphere : public hittable {
 public:
     sphere(point3 _center, double _radius, shared_ptr<material> _material)
-            : center(_center), radius(_radius), mat(_material) {}
+            : center(_center), radius(_radius), mat(_material) {
+        auto rvec = vec3(radius, radius, radius);
+        bbox = aabb(center - rvec, center + rvec);
+    }
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+        RT_COUNT(sphere_tests);
         vec3 oc = r.origin() - center;
         auto a = r.direction().length_squared();
         auto half_b = dot(oc, r.direction());
@@ -33,14 +38,51 @@ public:
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u, rec.v);
         rec.mat = mat;
+        rec.object = this;
 
         return true;
     }
 
+    aabb bounding_box() const override { return bbox; }
+
+    void hit_packet(const ray_packet &rays, double t_min, packet_hit &hits) const override {
+        RT_COUNT_N(sphere_tests, std::count(rays.active, rays.active + packet_width, 1));
+        const hittable *self = this; // Loop-invariant pointer, so the select below is a plain blend
+#pragma omp simd
+        for (int k = 0; k < packet_width; ++k) {
+            auto ocx = rays.origin_x[k] - center.x();
+            auto ocy = rays.origin_y[k] - center.y();
+            auto ocz = rays.origin_z[k] - center.z();
+            auto dx = rays.direction_x[k];
+            auto dy = rays.direction_y[k];
+            auto dz = rays.direction_z[k];
+
+            auto a = dx * dx + dy * dy + dz * dz;
+            auto half_b = ocx * dx + ocy * dy + ocz * dz;
+            auto c = ocx * ocx + ocy * ocy + ocz * ocz - radius * radius;
+            auto discriminant = half_b * half_b - a * c;
+            auto sqrtd = sqrt(discriminant > 0 ? discriminant : 0.0); // fmax does not vectorize
+
+            // Nearest root inside (t_min, t) as in the scalar test. The conditions are
+            // integer masks joined with & and | and the results are blended, so the loop
+            // has no branches and vectorizes.
+            auto near_root = (-half_b - sqrtd) / a;
+            auto far_root = (-half_b + sqrtd) / a;
+            int64_t near_ok = (t_min < near_root) & (near_root < hits.t[k]);
+            int64_t far_ok = (t_min < far_root) & (far_root < hits.t[k]);
+            int64_t found = rays.active[k] & (discriminant >= 0) & (near_ok | far_ok);
+
+            auto root = near_ok ? near_root : far_root;
+            hits.t[k] = found ? root : hits.t[k];
+            hits.object[k] = found ? self : hits.object[k];
+        }
+    }
+
 private:
     point3 center;
     double radius;
     shared_ptr<material> mat;
+    aabb bbox;
 
     static void get_sphere_uv(const point3 &p, double &u, double &v) {
         // p: a given point on the sphere of radius one, centered at the origin.
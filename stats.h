@@ -0,0 +1,164 @@
+#ifndef RAYTRACER_STATS_H
+#define RAYTRACER_STATS_H
+
+// Hot-path counters for profiling renders. Build with -DRAYTRACER_STATS=1 (or the
+// RAYTRACER_STATS CMake option) to enable them; otherwise every RT_COUNT and
+// RT_TIME_PHASE below expands to nothing and the counters are not compiled in at all.
+#ifndef RAYTRACER_STATS
+#define RAYTRACER_STATS 0
+#endif
+
+#if RAYTRACER_STATS
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+constexpr int stats_max_depth = 64; // Deeper rays are counted at the last depth
+
+enum class render_phase {
+    trace,   // Tracing tiles, passes or frames
+    denoise, // Denoising finished images
+    write,   // Resolving, tone mapping and encoding images
+    count
+};
+
+// Counters of one thread. Each is bumped without synchronization by its own thread only.
+struct render_counters {
+    uint64_t camera_rays = 0;
+    uint64_t rays_at_depth[stats_max_depth] = {}; // Rays traced after that many bounces
+    uint64_t sphere_tests = 0;
+    uint64_t quad_tests = 0;                      // Quads and triangles
+    uint64_t box_tests = 0;                       // Bounding box tests of ray packets
+    uint64_t shadow_rays = 0;
+    uint64_t phase_ns[static_cast<int>(render_phase::count)] = {};
+
+    void add(const render_counters &other) {
+        camera_rays += other.camera_rays;
+        for (int d = 0; d < stats_max_depth; ++d)
+            rays_at_depth[d] += other.rays_at_depth[d];
+        sphere_tests += other.sphere_tests;
+        quad_tests += other.quad_tests;
+        box_tests += other.box_tests;
+        shadow_rays += other.shadow_rays;
+        for (int p = 0; p < static_cast<int>(render_phase::count); ++p)
+            phase_ns[p] += other.phase_ns[p];
+    }
+};
+
+// Counters of the threads alive and the sum over the threads that have exited.
+struct stats_registry {
+    std::mutex mutex;
+    std::vector<const render_counters *> live;
+    render_counters retired;
+};
+
+inline stats_registry &global_stats() {
+    static stats_registry registry;
+    return registry;
+}
+
+struct thread_counters : render_counters {
+    thread_counters() {
+        auto &registry = global_stats();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.push_back(this);
+    }
+
+    ~thread_counters() {
+        // Worker threads fold their counters into the totals when they exit.
+        auto &registry = global_stats();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.retired.add(*this);
+        registry.live.erase(std::find(registry.live.begin(), registry.live.end(), this));
+    }
+};
+
+inline render_counters &thread_stats() {
+    thread_local thread_counters counters;
+    return counters;
+}
+
+inline render_counters total_stats() {
+    // Only exact while no other thread is rendering.
+    auto &registry = global_stats();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto total = registry.retired;
+    for (auto counters: registry.live)
+        total.add(*counters);
+    return total;
+}
+
+// Adds the time until the end of the scope to a phase of the current thread.
+class phase_timer {
+public:
+    explicit phase_timer(render_phase _phase) : phase(_phase), start(std::chrono::steady_clock::now()) {}
+
+    ~phase_timer() {
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+        thread_stats().phase_ns[static_cast<int>(phase)] += elapsed.count();
+    }
+
+private:
+    render_phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+inline void print_render_stats(std::ostream &out, double seconds) {
+    // Totals over all threads, rays per second of wall time and how many bounces the
+    // paths made. A path with n bounces traced rays at depths 0 to n, so the number
+    // of them is the rays at depth n minus the rays at depth n + 1.
+    auto stats = total_stats();
+    uint64_t rays = 0, bounces = 0;
+    for (int d = 0; d < stats_max_depth; ++d) {
+        rays += stats.rays_at_depth[d];
+        if (d > 0)
+            bounces += stats.rays_at_depth[d];
+    }
+
+    out << "Render statistics over " << seconds << " s\n"
+        << "  camera rays       " << stats.camera_rays << '\n'
+        << "  path rays         " << rays << " (" << bounces << " bounces)\n"
+        << "  shadow rays       " << stats.shadow_rays << '\n'
+        << "  rays per second   " << (seconds > 0 ? (rays + stats.shadow_rays) / seconds : 0.0) << '\n'
+        << "  sphere tests      " << stats.sphere_tests << '\n'
+        << "  quad tests        " << stats.quad_tests << '\n'
+        << "  box tests         " << stats.box_tests << '\n';
+
+    static const char *phase_names[] = {"trace", "denoise", "write"};
+    for (int p = 0; p < static_cast<int>(render_phase::count); ++p)
+        out << "  " << std::left << std::setw(18) << (std::string(phase_names[p]) + " time") << std::right
+            << stats.phase_ns[p] * 1e-9 << " s (summed over threads)\n";
+
+    out << "  path length histogram (bounces: paths)\n";
+    for (int d = 0; d < stats_max_depth; ++d) {
+        auto next = d + 1 < stats_max_depth ? stats.rays_at_depth[d + 1] : 0;
+        auto paths = stats.rays_at_depth[d] - next;
+        if (paths > 0)
+            out << "    " << std::setw(3) << d << ": " << paths << '\n';
+    }
+}
+
+#define RT_COUNT(field) (++thread_stats().field)
+#define RT_COUNT_N(field, n) (thread_stats().field += (n))
+#define RT_COUNT_RAYS(depth, n) \
+    (thread_stats().rays_at_depth[std::min<int>((depth), stats_max_depth - 1)] += (n))
+#define RT_TIME_CONCAT(a, b) a##b
+#define RT_TIME_NAME(line) RT_TIME_CONCAT(phase_timer_, line)
+#define RT_TIME_PHASE(phase) phase_timer RT_TIME_NAME(__LINE__)(render_phase::phase)
+
+#else
+
+#define RT_COUNT(field) ((void) 0)
+#define RT_COUNT_N(field, n) ((void) 0)
+#define RT_COUNT_RAYS(depth, n) ((void) 0)
+#define RT_TIME_PHASE(phase) ((void) 0)
+
+#endif
+
+#endif //RAYTRACER_STATS_H
@@ -0,0 +1,102 @@
+#ifndef RAYTRACER_STREAMED_IMAGE_H
+#define RAYTRACER_STREAMED_IMAGE_H
+
+#include "framebuffer.h"
+#include "image_io.h"
+#include "tone_map.h"
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Image file that is written tile by tile, for frames too large to hold in memory.
+// The file is created at its final size up front; every tile row then goes straight
+// to its offset with pwrite, which is safe from several threads at once as long as
+// the tiles do not overlap. Binary PPM by default, or linear PFM for .pfm paths.
+class streamed_image {
+public:
+    streamed_image(const std::string &_path, int _width, int _height, const tone_settings &_tone)
+            : path(_path), temporary(temporary_path(_path)), width(_width), height(_height), tone(_tone),
+              float_pixels(has_extension(_path, ".pfm")) {
+        std::string header = float_pixels
+                             ? "PF\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n-1.0\n"
+                             : "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+        header_size = static_cast<off_t>(header.size());
+
+        if (float_pixels && !little_endian_host()) {
+            std::cerr << "Streamed PFM output needs a little-endian host\n";
+            return;
+        }
+
+        fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        auto size = header_size + static_cast<off_t>(width) * height * pixel_size();
+        if (fd < 0 || ::ftruncate(fd, size) != 0
+            || ::pwrite(fd, header.data(), header.size(), 0) != static_cast<ssize_t>(header.size())) {
+            std::cerr << "Cannot create " << temporary << '\n';
+            failed = true;
+        }
+    }
+
+    streamed_image(const streamed_image &) = delete;
+
+    streamed_image &operator=(const streamed_image &) = delete;
+
+    ~streamed_image() {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    bool good() const { return fd >= 0 && !failed; }
+
+    void write_tile(int x0, int y0, const framebuffer &tile) {
+        // Writes the linear tile whose top-left pixel is (x0, y0) of the image.
+        RT_TIME_PHASE(write);
+        std::vector<unsigned char> bytes;
+        if (!float_pixels) {
+            bytes.resize(tile.data.size());
+            tone_map(tile, tone, bytes.data());
+        }
+
+        auto row_size = static_cast<size_t>(tile.width) * pixel_size();
+        for (int j = 0; j < tile.height; ++j) {
+            // PFM rows run bottom to top.
+            auto row = float_pixels ? height - 1 - (y0 + j) : y0 + j;
+            auto offset = header_size + (static_cast<off_t>(row) * width + x0) * pixel_size();
+            auto data = float_pixels ? static_cast<const void *>(tile.pixel(0, j))
+                                     : static_cast<const void *>(&bytes[static_cast<size_t>(j) * row_size]);
+            if (::pwrite(fd, data, row_size, offset) != static_cast<ssize_t>(row_size))
+                failed = true;
+        }
+    }
+
+    bool finish() {
+        // Closes the file and moves it into place; false if any write failed.
+        if (fd < 0)
+            return false;
+        auto closed = ::close(fd) == 0;
+        fd = -1;
+        return finish_write(temporary, path, closed && !failed);
+    }
+
+private:
+    std::string path;
+    std::string temporary;
+    int width;
+    int height;
+    tone_settings tone;
+    bool float_pixels;
+    off_t header_size = 0;
+    int fd = -1;
+    std::atomic<bool> failed{false};
+
+    off_t pixel_size() const {
+        return float_pixels ? 3 * sizeof(float) : 3;
+    }
+};
+
+#endif //RAYTRACER_STREAMED_IMAGE_H
@@ -0,0 +1,94 @@
+#ifndef RAYTRACER_TEMPORAL_H
+#define RAYTRACER_TEMPORAL_H
+
+#include "rtweekend.h"
+
+#include "accumulation_buffer.h"
+#include "camera.h"
+#include "hittable.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Keeps accumulated samples alive across camera moves. Every pixel remembers the world
+// position of its first hit; after a move a pixel's new first hit is projected into the
+// previous view, and if the previous pixel there saw (nearly) the same point its
+// estimate is carried over as up to max_history samples. Pixels whose point was hidden
+// or outside the previous view (disocclusion) start from zero samples.
+class temporal_history {
+public:
+    int max_history = 16;             // Weight in samples that carried-over history may keep
+    double position_tolerance = 0.02; // Allowed position mismatch, relative to the distance
+
+    temporal_history(int _width, int _height)
+            : width(_width), height(_height),
+              positions(static_cast<size_t>(_width) * _height),
+              valid(static_cast<size_t>(_width) * _height, 0),
+              history_film(_width, _height),
+              history_positions(positions.size()),
+              history_valid(valid.size(), 0) {}
+
+    void capture(const camera &cam, accumulation_buffer &film) {
+        // Makes the current film and first hits the history for the next reprojection;
+        // cam is the (prepared) camera they were rendered with, and every pixel must have
+        // gone through reproject_pixel for it. The film is left holding the older
+        // history, which reproject_pixel overwrites.
+        history_camera = cam;
+        has_history = true;
+        std::swap(history_film, film);
+        std::swap(history_positions, positions);
+        std::swap(history_valid, valid);
+    }
+
+    void reproject_pixel(const camera &cam, const hittable &world, accumulation_buffer &film, int i, int j) {
+        // Finds the first hit of pixel (i, j) in the new view and seeds the pixel with
+        // the matching history, or with nothing.
+        auto index = static_cast<size_t>(j) * width + i;
+        film.sum[index] = color(0, 0, 0);
+        film.sum_squares[index] = 0;
+        film.samples[index] = 0;
+
+        hit_record rec;
+        valid[index] = cam.center_hit(world, i, j, rec);
+        if (!valid[index])
+            return;
+        positions[index] = rec.p;
+
+        double x, y;
+        if (!has_history || !history_camera.project(rec.p, x, y))
+            return;
+        auto pi = static_cast<int>(floor(x + 0.5));
+        auto pj = static_cast<int>(floor(y + 0.5));
+        if (pi < 0 || pi >= width || pj < 0 || pj >= height)
+            return;
+
+        auto previous = static_cast<size_t>(pj) * width + pi;
+        auto n = history_film.samples[previous];
+        if (!history_valid[previous] || n == 0)
+            return;
+
+        auto tolerance = position_tolerance * (rec.p - cam.lookfrom).length();
+        if ((history_positions[previous] - rec.p).length() > tolerance)
+            return;
+
+        auto weight = std::min(n, max_history);
+        film.sum[index] = history_film.sum[previous] * (static_cast<double>(weight) / n);
+        film.sum_squares[index] = history_film.sum_squares[previous] * (static_cast<double>(weight) / n);
+        film.samples[index] = weight;
+    }
+
+private:
+    int width;
+    int height;
+    std::vector<point3> positions;
+    std::vector<char> valid;
+
+    camera history_camera;
+    accumulation_buffer history_film;
+    std::vector<point3> history_positions;
+    std::vector<char> history_valid;
+    bool has_history = false;
+};
+
+#endif //RAYTRACER_TEMPORAL_H
@@ -0,0 +1,75 @@
+#ifndef RAYTRACER_TILE_POOL_H
+#define RAYTRACER_TILE_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Rectangle [x0, x1) x [y0, y1) of the image of one view.
+struct render_tile {
+    int view;
+    int x0, y0, x1, y1;
+};
+
+// The tiles of one image in scanline order, computed on demand so that even a huge
+// image needs no list of them.
+struct tile_grid {
+    int view;
+    int width, height;
+    int tile_size;
+
+    size_t columns() const { return (width + tile_size - 1) / tile_size; }
+
+    size_t count() const { return columns() * ((height + tile_size - 1) / tile_size); }
+
+    render_tile at(size_t k) const {
+        auto x = static_cast<int>(k % columns()) * tile_size;
+        auto y = static_cast<int>(k / columns()) * tile_size;
+        return {view, x, y, std::min(x + tile_size, width), std::min(y + tile_size, height)};
+    }
+};
+
+inline void append_tiles(std::vector<render_tile> &tiles, int view, int width, int height, int tile_size) {
+    tile_grid grid{view, width, height, tile_size};
+    for (size_t k = 0; k < grid.count(); ++k)
+        tiles.push_back(grid.at(k));
+}
+
+inline int worker_count(int requested) {
+    // Zero asks for one worker per hardware thread.
+    if (requested > 0)
+        return requested;
+    return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+// Runs work(k, worker) for k = 0 .. count - 1 on a fixed set of worker threads.
+// Workers take the next k from a shared atomic counter, so the jobs are balanced over
+// the workers no matter how expensive each one is. setup(worker) runs once on each
+// worker thread before its first job.
+template<typename Setup, typename Work>
+void run_jobs(size_t count, int workers, Setup setup, Work work) {
+    std::atomic<size_t> next_job{0};
+
+    auto worker_main = [&](int worker) {
+        setup(worker);
+        for (size_t k = next_job++; k < count; k = next_job++)
+            work(k, worker);
+    };
+
+    std::vector<std::thread> threads;
+    for (int worker = 1; worker < workers; ++worker)
+        threads.emplace_back(worker_main, worker);
+    worker_main(0);
+
+    for (auto &thread: threads)
+        thread.join();
+}
+
+// run_jobs over a list of tiles, e.g. those of several views: work(tile, worker).
+template<typename Setup, typename Work>
+void run_tiles(const std::vector<render_tile> &tiles, int workers, Setup setup, Work work) {
+    run_jobs(tiles.size(), workers, setup, [&](size_t k, int worker) { work(tiles[k], worker); });
+}
+
+#endif //RAYTRACER_TILE_POOL_H
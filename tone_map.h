@@ -0,0 +1,74 @@
+#ifndef RAYTRACER_TONE_MAP_H
+#define RAYTRACER_TONE_MAP_H
+
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// How linear values above 1 are brought into display range.
+enum class tone_curve {
+    clamp,    // Cut off at 1, the classic look
+    reinhard, // x / (1 + x) per channel
+    aces      // Narkowicz's fit of the ACES filmic curve
+};
+
+// How display-range linear values are encoded in 8 bits.
+enum class transfer_curve {
+    gamma_2, // Square root, what the renderer has always written
+    srgb     // Piecewise sRGB curve
+};
+
+struct tone_settings {
+    float exposure = 0;                                // Stops; every value is scaled by 2^exposure
+    tone_curve curve = tone_curve::clamp;              // Highlight compression
+    transfer_curve transfer = transfer_curve::gamma_2; // 8-bit encoding
+};
+
+inline void tone_map(const framebuffer &image, const tone_settings &settings, unsigned char *out) {
+    // Turns the linear framebuffer into 8-bit display values, three per pixel. The
+    // channels are treated as one flat array and every stage is a separate loop over a
+    // cache-sized chunk, so each loop vectorizes; the framebuffer stays linear and can
+    // be graded again with other settings.
+    constexpr size_t chunk = 4096;
+    float v[chunk];
+
+    const float *values = image.data.data();
+    auto count = image.data.size();
+    auto scale = std::exp2(settings.exposure);
+
+    for (size_t base = 0; base < count; base += chunk) {
+        auto n = std::min(chunk, count - base);
+
+        #pragma omp simd
+        for (size_t k = 0; k < n; ++k)
+            v[k] = std::max(values[base + k] * scale, 0.0f);
+
+        if (settings.curve == tone_curve::reinhard) {
+            #pragma omp simd
+            for (size_t k = 0; k < n; ++k)
+                v[k] = v[k] / (1.0f + v[k]);
+        } else if (settings.curve == tone_curve::aces) {
+            #pragma omp simd
+            for (size_t k = 0; k < n; ++k)
+                v[k] = (v[k] * (2.51f * v[k] + 0.03f)) / (v[k] * (2.43f * v[k] + 0.59f) + 0.14f);
+        }
+
+        if (settings.transfer == transfer_curve::gamma_2) {
+            #pragma omp simd
+            for (size_t k = 0; k < n; ++k)
+                v[k] = std::sqrt(v[k]);
+        } else {
+            #pragma omp simd
+            for (size_t k = 0; k < n; ++k)
+                v[k] = v[k] <= 0.0031308f ? 12.92f * v[k] : 1.055f * std::pow(v[k], 1.0f / 2.4f) - 0.055f;
+        }
+
+        // 256 * v, kept just below 256 so that 1.0 maps to 255.
+        #pragma omp simd
+        for (size_t k = 0; k < n; ++k)
+            out[base + k] = static_cast<unsigned char>(static_cast<int>(256.0f * std::min(v[k], 0.999f)));
+    }
+}
+
+#endif //RAYTRACER_TONE_MAP_H
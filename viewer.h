@@ -0,0 +1,266 @@
+#ifndef RAYTRACER_VIEWER_H
+#define RAYTRACER_VIEWER_H
+
+#include "rtweekend.h"
+
+#include "accumulation_buffer.h"
+#include "camera.h"
+#include "color.h"
+#include "framebuffer.h"
+#include "hittable.h"
+#include "temporal.h"
+#include "tone_map.h"
+
+#include <SFML/Graphics.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Interactive window that shows the accumulation buffer while it converges.
+//   W/A/S/D, Q/E   move the camera forward/left/back/right, down/up
+//   left drag      look around
+//   mouse wheel    field of view
+//   R/F, T/G       defocus angle, focus distance
+//   Escape         close
+// Render threads take interleaved rows of the film and publish finished rows as
+// packed RGBA words; the UI thread only reads those words, so it never waits on a
+// render thread. The render threads meet at a barrier between frames of
+// samples_per_frame samples. Any camera change bumps a generation counter; the
+// current frame is abandoned and the next one restarts accumulation, carrying
+// over reprojected history when temporal_reprojection is on (see temporal.h).
+class viewer {
+public:
+    double move_speed = 2.0;      // Scene units per second
+    double look_speed = 0.005;    // Radians per pixel of mouse drag
+    int samples_per_frame = 1;    // Samples added to every pixel per frame
+    bool temporal_reprojection = true; // Keep reprojected samples across camera moves
+
+    viewer(const camera &cam, const hittable &_world)
+            : view(cam), world(_world), width(cam.image_width), height(cam.full_image_height()),
+              film(width, height), history(width, height), display(static_cast<size_t>(width) * height) {}
+
+    void run() {
+        sf::RenderWindow window(sf::VideoMode(width, height), "raytracer");
+        window.setFramerateLimit(60);
+
+        sf::Texture texture;
+        texture.create(width, height);
+        sf::Sprite sprite(texture);
+        std::vector<sf::Uint8> pixels(static_cast<size_t>(width) * height * 4);
+
+        running = true;
+        auto thread_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        std::barrier frame_barrier(thread_count);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; ++t)
+            threads.emplace_back([this, t, thread_count, &frame_barrier] {
+                render_loop(t, thread_count, frame_barrier);
+            });
+
+        bool dragging = false;
+        int last_x = 0, last_y = 0;
+        sf::Clock clock;
+
+        while (window.isOpen()) {
+            sf::Event event;
+            while (window.pollEvent(event)) {
+                if (event.type == sf::Event::Closed
+                    || (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape)) {
+                    window.close();
+                } else if (event.type == sf::Event::MouseButtonPressed
+                           && event.mouseButton.button == sf::Mouse::Left) {
+                    dragging = true;
+                    last_x = event.mouseButton.x;
+                    last_y = event.mouseButton.y;
+                } else if (event.type == sf::Event::MouseButtonReleased
+                           && event.mouseButton.button == sf::Mouse::Left) {
+                    dragging = false;
+                } else if (event.type == sf::Event::MouseMoved && dragging) {
+                    look(event.mouseMove.x - last_x, event.mouseMove.y - last_y);
+                    last_x = event.mouseMove.x;
+                    last_y = event.mouseMove.y;
+                } else if (event.type == sf::Event::MouseWheelScrolled) {
+                    change([&](camera &c) {
+                        c.vfov = std::clamp(c.vfov - 2.0 * event.mouseWheelScroll.delta, 1.0, 170.0);
+                    });
+                }
+            }
+
+            handle_keys(clock.restart().asSeconds());
+
+            for (size_t k = 0; k < display.size(); ++k) {
+                auto rgba = display[k].load(std::memory_order_relaxed);
+                pixels[4 * k + 0] = static_cast<sf::Uint8>(rgba);
+                pixels[4 * k + 1] = static_cast<sf::Uint8>(rgba >> 8);
+                pixels[4 * k + 2] = static_cast<sf::Uint8>(rgba >> 16);
+                pixels[4 * k + 3] = static_cast<sf::Uint8>(rgba >> 24);
+            }
+            texture.update(pixels.data());
+
+            window.setTitle("raytracer - " + std::to_string(frames_shown.load()) + " frames accumulated");
+            window.clear();
+            window.draw(sprite);
+            window.display();
+        }
+
+        running = false;
+        for (auto &thread: threads)
+            thread.join();
+    }
+
+private:
+    camera view;             // Parameters as last set by the UI, guarded by view_mutex
+    std::mutex view_mutex;
+    std::atomic<int> generation{0};
+
+    const hittable &world;
+    int width;
+    int height;
+    accumulation_buffer film; // Each row is only ever touched by one render thread
+    temporal_history history;
+    std::vector<std::atomic<uint32_t>> display;
+    std::atomic<int> frames_shown{0};
+    std::atomic<bool> running{false};
+
+    // Set by render thread 0 between frames, read-only for all threads during a frame.
+    camera frame_camera;
+    int frame_generation = -1;
+    bool frame_restart = false;
+    bool frame_running = true;
+    int frames_accumulated = 0;
+
+    template<typename F>
+    void change(F &&modify) {
+        std::lock_guard<std::mutex> lock(view_mutex);
+        modify(view);
+        ++generation;
+    }
+
+    void handle_keys(double seconds) {
+        using key = sf::Keyboard;
+        auto step = move_speed * seconds;
+        auto forward = (key::isKeyPressed(key::W) ? step : 0.0) - (key::isKeyPressed(key::S) ? step : 0.0);
+        auto right = (key::isKeyPressed(key::D) ? step : 0.0) - (key::isKeyPressed(key::A) ? step : 0.0);
+        auto up = (key::isKeyPressed(key::E) ? step : 0.0) - (key::isKeyPressed(key::Q) ? step : 0.0);
+        auto defocus = (key::isKeyPressed(key::R) ? seconds : 0.0) - (key::isKeyPressed(key::F) ? seconds : 0.0);
+        auto focus = (key::isKeyPressed(key::T) ? step : 0.0) - (key::isKeyPressed(key::G) ? step : 0.0);
+
+        if (forward == 0 && right == 0 && up == 0 && defocus == 0 && focus == 0)
+            return;
+
+        change([&](camera &c) {
+            auto w = unit_vector(c.lookat - c.lookfrom);
+            auto u = unit_vector(cross(w, c.vup));
+            auto offset = forward * w + right * u + up * unit_vector(c.vup);
+            c.lookfrom += offset;
+            c.lookat += offset;
+            c.defocus_angle = std::max(0.0, c.defocus_angle + 5 * defocus);
+            c.focus_dist = std::max(0.1, c.focus_dist + focus);
+        });
+    }
+
+    void look(int dx, int dy) {
+        change([&](camera &c) {
+            auto w = c.lookat - c.lookfrom;
+            auto u = unit_vector(cross(w, c.vup));
+            w = rotate(w, unit_vector(c.vup), -dx * look_speed);
+            auto pitched = rotate(w, u, -dy * look_speed);
+            // Stop just short of looking straight up or down, where vup is degenerate.
+            if (fabs(dot(unit_vector(pitched), unit_vector(c.vup))) < 0.99)
+                w = pitched;
+            c.lookat = c.lookfrom + w;
+        });
+    }
+
+    static vec3 rotate(const vec3 &v, const vec3 &axis, double angle) {
+        // Rodrigues' rotation of v around the unit vector axis.
+        return v * cos(angle) + cross(axis, v) * sin(angle) + axis * dot(axis, v) * (1 - cos(angle));
+    }
+
+    void render_loop(int thread_index, int thread_count, std::barrier<> &frame_barrier) {
+        camera local;
+        int local_generation = -1;
+
+        while (true) {
+            if (thread_index == 0)
+                begin_frame();
+            frame_barrier.arrive_and_wait();
+            if (!frame_running)
+                return;
+
+            if (local_generation != frame_generation) {
+                local = frame_camera;
+                local.pixel_sampler = local.pixel_sampler->clone();
+                local_generation = frame_generation;
+            }
+
+            if (frame_restart) {
+                for (int j = thread_index; j < height; j += thread_count)
+                    for (int i = 0; i < width; ++i)
+                        restart_pixel(local, i, j);
+            }
+
+            for (int j = thread_index; j < height && generation == frame_generation; j += thread_count) {
+                local.render_row(world, film, j, samples_per_frame);
+                publish_row(local, j);
+            }
+
+            frame_barrier.arrive_and_wait();
+        }
+    }
+
+    void begin_frame() {
+        // Runs on render thread 0 while the others wait at the barrier.
+        frame_running = running;
+        int current_generation = generation;
+        frame_restart = current_generation != frame_generation;
+
+        if (frame_restart) {
+            if (temporal_reprojection && frame_generation >= 0)
+                history.capture(frame_camera, film);
+            {
+                std::lock_guard<std::mutex> lock(view_mutex);
+                frame_camera = view;
+            }
+            frame_camera.prepare();
+            frame_generation = current_generation;
+            frames_accumulated = 0;
+        }
+
+        frames_shown = ++frames_accumulated;
+    }
+
+    void restart_pixel(const camera &cam, int i, int j) {
+        if (temporal_reprojection) {
+            history.reproject_pixel(cam, world, film, i, j);
+            return;
+        }
+        auto index = static_cast<size_t>(j) * width + i;
+        film.sum[index] = color(0, 0, 0);
+        film.sum_squares[index] = 0;
+        film.samples[index] = 0;
+    }
+
+    void publish_row(const camera &cam, int j) {
+        // Tone mapped with the camera's settings, so the window shows what would be written.
+        framebuffer row(width, 1);
+        for (int i = 0; i < width; ++i)
+            row.set(i, 0, film.estimate(i, j));
+        std::vector<unsigned char> rgb(static_cast<size_t>(width) * 3);
+        tone_map(row, cam.tone, rgb.data());
+
+        for (int i = 0; i < width; ++i) {
+            auto index = static_cast<size_t>(j) * width + i;
+            auto p = &rgb[3 * i];
+            display[index].store(p[0] | (p[1] << 8) | (p[2] << 16) | (0xffU << 24), std::memory_order_relaxed);
+        }
+    }
+};
+
+#endif //RAYTRACER_VIEWER_H
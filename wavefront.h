@@ -0,0 +1,159 @@
+#ifndef RAYTRACER_WAVEFRONT_H
+#define RAYTRACER_WAVEFRONT_H
+
+#include "rtweekend.h"
+
+#include "accumulation_buffer.h"
+#include "color.h"
+#include "hittable.h"
+#include "material.h"
+#include "ray_sort.h"
+#include "sampler.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <typeindex>
+#include <vector>
+
+// State of one camera path while it waits in a queue between stages.
+struct wavefront_path {
+    ray r;
+    color throughput = color(1, 1, 1);
+    color radiance = color(0, 0, 0);
+    int pixel_i = 0;
+    int pixel_j = 0;
+    int sample_index = 0;
+    int dimension = 0; // Sampler dimensions already used by this path
+};
+
+// Breadth-first integrator: instead of following one path to the end before starting
+// the next, it advances a whole batch of paths one bounce at a time in stages.
+//   extend: intersect every queued ray with the scene,
+//   sort:   group the hits by material type and then by material instance,
+//   shade:  run each material's scatter over its group and queue the continuations.
+// Each stage runs a single kind of code over many rays, which keeps the instruction
+// cache and the material data warm. The materials here do no light sampling, so there
+// is no shadow-ray stage; a continuation queue is all the next bounce needs.
+// With reorder_secondary the continuation queue is sorted by origin cell and
+// direction octant before it is intersected (see ray_sort.h).
+class wavefront_integrator {
+public:
+    bool reorder_secondary = false;
+    ray_order_stats primary_stats;   // Intersection of camera rays
+    ray_order_stats secondary_stats; // Intersection of all later bounces
+
+    wavefront_integrator(const hittable &_world, const color &_background, int _max_depth)
+            : world(_world), background(_background), max_depth(_max_depth) {}
+
+    // Traces the paths to completion and adds one sample per path to the film.
+    void trace(std::vector<wavefront_path> &paths, sampler &s, accumulation_buffer &film) {
+        active.clear();
+        for (size_t k = 0; k < paths.size(); ++k)
+            active.push_back(static_cast<int>(k));
+
+        sampler *previous_sampler = active_sampler();
+        active_sampler() = &s;
+
+        for (int depth = max_depth; depth > 0 && !active.empty(); --depth) {
+            bool secondary = depth < max_depth;
+            if (secondary && reorder_secondary)
+                reorder(paths);
+            RT_COUNT_RAYS(max_depth - depth, active.size());
+            extend(paths, secondary ? secondary_stats : primary_stats);
+            sort_hits();
+            shade(paths, s);
+            std::swap(active, next);
+        }
+
+        // Paths still active ran out of bounces and gather no more light.
+        for (auto &path: paths)
+            film.add_sample(path.pixel_i, path.pixel_j, path.radiance);
+
+        active_sampler() = previous_sampler;
+    }
+
+private:
+    struct queued_hit {
+        int path;
+        hit_record rec;
+        std::type_index kind = typeid(void);
+    };
+
+    const hittable &world;
+    color background;
+    int max_depth;
+
+    std::vector<int> active;
+    std::vector<int> next;
+    std::vector<queued_hit> hits;
+    std::vector<uint64_t> keys;
+
+    void reorder(const std::vector<wavefront_path> &paths) {
+        aabb origin_bounds;
+        for (auto index: active) {
+            auto o = paths[index].r.origin();
+            origin_bounds = aabb(origin_bounds, aabb(o, o));
+        }
+
+        keys.clear();
+        for (auto index: active)
+            keys.push_back(ray_sort_key(paths[index].r, origin_bounds));
+        radix_sort_by_key(active, keys);
+    }
+
+    void extend(std::vector<wavefront_path> &paths, ray_order_stats &stats) {
+        auto start = std::chrono::steady_clock::now();
+        const hittable *previous_object = nullptr;
+
+        hits.clear();
+        for (auto index: active) {
+            auto &path = paths[index];
+            queued_hit hit;
+            hit.path = index;
+            if (!world.hit(path.r, interval(0.001, infinity), hit.rec)) {
+                path.radiance += path.throughput * background;
+                continue;
+            }
+            hit.kind = typeid(*hit.rec.mat);
+            if (hit.rec.object != previous_object)
+                ++stats.primitive_switches;
+            previous_object = hit.rec.object;
+            hits.push_back(hit);
+        }
+
+        stats.rays += static_cast<long long>(active.size());
+        stats.intersect_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void sort_hits() {
+        std::stable_sort(hits.begin(), hits.end(), [](const queued_hit &a, const queued_hit &b) {
+            if (a.kind != b.kind)
+                return a.kind < b.kind;
+            return a.rec.mat.get() < b.rec.mat.get();
+        });
+    }
+
+    void shade(std::vector<wavefront_path> &paths, sampler &s) {
+        next.clear();
+        for (auto &hit: hits) {
+            auto &path = paths[hit.path];
+            auto &rec = hit.rec;
+
+            path.radiance += path.throughput * rec.mat->emitted(rec.u, rec.v, rec.p);
+
+            s.resume_pixel_sample(path.pixel_i, path.pixel_j, path.sample_index, path.dimension);
+            ray scattered;
+            color attenuation;
+            if (!rec.mat->scatter(path.r, rec, attenuation, scattered))
+                continue;
+            path.dimension = s.current_dimension();
+
+            path.throughput = path.throughput * attenuation;
+            path.r = scattered;
+            next.push_back(hit.path);
+        }
+    }
+};
+
+#endif //RAYTRACER_WAVEFRONT_H